@@ -0,0 +1,662 @@
+// Microbenchmarks for the systems, factories and fixed-point maths, on the
+// host build. Prints CSV to stdout, one row per measurement:
+//   scenario,subject,n,iterations,ns_per_iteration,ns_per_entity
+// Usage: MagicBattleBench [n...]   (default: 10 100 1000 10000)
+// Built with MAGIC_BATTLE_STATS, it also prints the counters for each
+// measurement to stderr, per iteration:
+//   scenario/subject/n,counter,total,per_iteration
+// Built with MAGIC_BATTLE_ALLOC_TRACKING, it prints the allocations in the
+// last iteration of each measurement to stderr, by system:
+//   scenario/subject/n,subject/system,allocations,bytes
+// The pacing scenario runs the game loop against the VBlank clock, and prints
+// how many frames were late or skipped to stderr in the same form.
+// It exits with an error first if the batch kernels don't agree with their
+// portable loops. Built with MAGIC_BATTLE_PARALLEL, the parallel scenario
+// times the range systems, and the cleanup pipeline's one wave of systems, on
+// one thread and on the pool, and exits with an error if they give different
+// results.
+#include "alloc_tracking.hpp"
+#include "components.hpp"
+#include "frame_pipeline.hpp"
+#include "ndspp.hpp"
+#include "particles.hpp"
+#include "pipeline.hpp"
+#include "scheduler.hpp"
+#include "sprite_sort.hpp"
+#include "stats.hpp"
+#include "systems.hpp"
+#include "tcm.hpp"
+#include "tecs.hpp"
+#include "util.hpp"
+#include "world.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <nds.h>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Normally defined in main.cpp.
+SpriteIdManager sprite_id_manager;
+AffineIdManager affine_index_manager;
+PaletteIdManager palette_index_manager;
+Camera camera;
+WorldChunks world_chunks;
+ParticlePool particle_pool;
+SpriteSorter sprite_sorter;
+
+using namespace Tecs;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int DEFAULT_SIZES[] = {10, 100, 1000, 10000};
+// Each measurement repeats until it has taken at least this long.
+constexpr auto MIN_DURATION = std::chrono::milliseconds(200);
+// The pacing scenario presents this many frames, or stops after
+// PACING_DURATION if simulation is too slow to get there.
+constexpr uint32_t PACING_FRAMES = 120;
+constexpr auto PACING_DURATION = std::chrono::seconds(3);
+
+constexpr nds::fix FIX_SCREEN_WIDTH = nds::fix::from_int(SCREEN_WIDTH);
+constexpr nds::fix FIX_SCREEN_HEIGHT = nds::fix::from_int(SCREEN_HEIGHT);
+constexpr Vec3 SCREEN_CENTRE = {nds::fix::from_int(SCREEN_WIDTH / 2),
+                                nds::fix::from_int(SCREEN_HEIGHT / 2), {0}};
+constexpr nds::fix ZOMBIE_SPEED = nds::fix::from_float(0.25f);
+
+// Blank graphics: the benchmarks never look at the pixels.
+uint8_t blank_gfx[64 * 64];
+uint8_t blank_palette[512];
+_ext_palette palette_memory;
+
+struct Sprites {
+  SpriteData zombie{&oamMain,
+                    blank_gfx,
+                    16,
+                    16,
+                    1,
+                    palette_index_manager,
+                    SpriteColorFormat_256Color,
+                    blank_palette,
+                    sizeof(blank_palette),
+                    palette_memory,
+                    0,
+                    SpriteExhaustion::EvictFarthest};
+  SpriteData player{&oamMain,
+                    blank_gfx,
+                    16,
+                    16,
+                    1,
+                    palette_index_manager,
+                    SpriteColorFormat_256Color,
+                    blank_palette,
+                    sizeof(blank_palette),
+                    palette_memory,
+                    3,
+                    SpriteExhaustion::EvictLowestPriority};
+  SpriteData fireball{&oamMain,
+                      blank_gfx,
+                      8,
+                      8,
+                      1,
+                      palette_index_manager,
+                      SpriteColorFormat_256Color,
+                      blank_palette,
+                      sizeof(blank_palette),
+                      palette_memory,
+                      1,
+                      SpriteExhaustion::EvictFarthest};
+  SpriteData explosion{&oamMain,
+                       blank_gfx,
+                       64,
+                       64,
+                       1,
+                       palette_index_manager,
+                       SpriteColorFormat_256Color,
+                       blank_palette,
+                       sizeof(blank_palette),
+                       palette_memory,
+                       2,
+                       SpriteExhaustion::EvictLowestPriority};
+};
+
+nds::fix random_fix(int32_t limit) { return nds::fix::from_int(rand() % limit); }
+
+// Range systems are run as a pipeline runs them: gathered, then split across
+// threads in a parallel build.
+using ApplyVelocity = System<"apply_velocity", apply_velocity, Signature<>>;
+using FollowingAi = System<"following_ai", following_ai, Signature<>>;
+
+// One component of some entities, to put back after the systems change it.
+// The components are held by address, since restoring runs before every timed
+// run and nothing adds or removes components in between.
+template <typename T> struct SavedComponents {
+  std::vector<std::pair<T *, T>> values;
+
+  void save(Coordinator &ecs, const std::unordered_set<Entity> &entities) {
+    values.clear();
+    for (const Entity entity : entities) {
+      T &component = ecs.getComponent<T>(entity);
+      values.emplace_back(&component, component);
+    }
+  }
+  void restore() const {
+    for (const auto &[component, value] : values) {
+      *component = value;
+    }
+  }
+};
+
+// A game world set up like main() does, with the entity sets each system
+// would be given kept by hand, besides the cleanup pipeline's.
+struct World {
+  Sprites &sprites;
+  Coordinator ecs;
+  Entity player_target;
+  Entity player;
+  std::unordered_set<Entity> moving;
+  std::unordered_set<Entity> following;
+  std::unordered_set<Entity> colliding;
+  std::unordered_set<Entity> drawn;
+  std::unordered_set<Entity> tracked;
+  std::unordered_set<Entity> trailing;
+  CleanupPipeline cleanup;
+
+  // What the measured systems change, from save().
+  SavedComponents<Position> positions;
+  SavedComponents<Velocity> velocities;
+  SavedComponents<Health> healths;
+  SavedComponents<ParticleTrail> trails;
+  SavedComponents<ChunkCell> cells;
+  WorldChunks chunks;
+  ParticlePool particles;
+
+  explicit World(Sprites &sprites) : sprites{sprites} {
+    sprite_id_manager.reset();
+    world_chunks.reset();
+    particle_pool.clear();
+    sprite_sorter.reset(sprite_id_manager);
+    register_component<Position>(ecs);
+    register_component<Velocity>(ecs);
+    register_component<SpriteInfo>(ecs);
+    register_component<Zombie>(ecs);
+    register_component<Collision>(ecs);
+    register_component<DeathMark>(ecs);
+    register_component<Following>(ecs);
+    register_component<TimerCallback>(ecs);
+    register_component<Health>(ecs);
+    register_component<ChunkCell>(ecs);
+    register_component<Awake>(ecs);
+    register_component<ParticleTrail>(ecs);
+    cleanup.declare(ecs);
+
+    player_target = ecs.newEntity();
+    ecs.addComponents(player_target, Position{SCREEN_CENTRE});
+
+    player = ecs.newEntity();
+    ecs.addComponents(player, Position{SCREEN_CENTRE}, Velocity{},
+                      Following{player_target, nds::fix::from_float(5.0f)},
+                      Health{10},
+                      Collision{ZOMBIE_LAYER, PLAYER_LAYER,
+                                radius_squared_from_diameter(
+                                    nds::fix::from_int(sprites.player.width)),
+                                take_damage},
+                      ChunkCell{NO_CHUNK}, Awake{});
+    make_sprite(ecs, player, sprite_id_manager, sprites.player);
+    moving.insert(player);
+    following.insert(player);
+    colliding.insert(player);
+    drawn.insert(player);
+    tracked.insert(player);
+  }
+
+  void add_zombie(Vec3 position) {
+    const Entity zombie = make_zombie(ecs, position, player, ZOMBIE_SPEED,
+                                      sprite_id_manager, sprites.zombie);
+    moving.insert(zombie);
+    following.insert(zombie);
+    colliding.insert(zombie);
+    drawn.insert(zombie);
+    tracked.insert(zombie);
+  }
+
+  void add_fireball(Vec3 position, Vec3 target) {
+    const Entity fireball = make_fireball(ecs, position, target,
+                                          sprite_id_manager, sprites.fireball);
+    moving.insert(fireball);
+    colliding.insert(fireball);
+    drawn.insert(fireball);
+    tracked.insert(fireball);
+    trailing.insert(fireball);
+  }
+
+  void add_explosion(Vec3 position) {
+    const Entity explosion =
+        make_explosion(ecs, position, sprite_id_manager, sprites.explosion);
+    colliding.insert(explosion);
+    drawn.insert(explosion);
+    tracked.insert(explosion);
+  }
+
+  // Keep the scene as it is now, for restore() to go back to.
+  void save() {
+    positions.save(ecs, tracked);
+    velocities.save(ecs, moving);
+    healths.save(ecs, colliding);
+    trails.save(ecs, trailing);
+    cells.save(ecs, tracked);
+    chunks = world_chunks;
+    particles = particle_pool;
+  }
+
+  void restore() {
+    positions.restore();
+    velocities.restore();
+    healths.restore();
+    trails.restore();
+    cells.restore();
+    world_chunks = chunks;
+    particle_pool = particles;
+  }
+};
+
+void print_header() {
+  printf("scenario,subject,n,iterations,ns_per_iteration,ns_per_entity\n");
+}
+
+void print_row(const char *scenario, const char *subject, int n,
+               long iterations, Clock::duration total) {
+  const double ns =
+      std::chrono::duration<double, std::nano>(total).count() / iterations;
+  printf("%s,%s,%d,%ld,%.1f,%.3f\n", scenario, subject, n, iterations, ns,
+         ns / n);
+  fflush(stdout);
+}
+
+// Time run() until MIN_DURATION has passed, calling setup() untimed before
+// each run.
+template <typename Setup, typename Run>
+void measure(const char *scenario, const char *subject, int n, Setup &&setup,
+             Run &&run) {
+  long iterations = 0;
+  Clock::duration total{};
+  hot_arena.take_peak();
+  while (total < MIN_DURATION) {
+    setup();
+    // Count only what run() does.
+    stats::reset();
+    alloc::reset();
+    alloc::phase(subject);
+    const auto start = Clock::now();
+    run();
+    total += Clock::now() - start;
+    iterations++;
+  }
+  STAT_SET(HotArenaPeak, hot_arena.take_peak());
+  stats::end_frame();
+  alloc::end_frame();
+  print_row(scenario, subject, n, iterations, total);
+
+  char label[96];
+  snprintf(label, sizeof(label), "%s/%s/%d", scenario, subject, n);
+  stats::dump(stderr, label);
+  alloc::dump(stderr, label);
+}
+
+template <typename Run>
+void measure(const char *scenario, const char *subject, int n, Run &&run) {
+  measure(scenario, subject, n, [] {}, run);
+}
+
+// Each run starts from the scene as the scenario set it up, whatever the
+// runs before it moved, damaged or filed.
+void measure_systems(const char *scenario, int n, World &world) {
+  Coordinator &ecs = world.ecs;
+  world.save();
+  const auto restore = [&] { world.restore(); };
+  measure(scenario, "apply_velocity", n, restore,
+          [&] { ApplyVelocity::run(ecs, world.moving); });
+  measure(scenario, "following_ai", n, restore,
+          [&] { FollowingAi::run(ecs, world.following); });
+  measure(scenario, "circular_collision_detection", n, restore,
+          [&] { circular_collision_detection(ecs, world.colliding); });
+  measure(scenario, "particle_trails", n, restore,
+          [&] { particle_trails(ecs, world.trailing); });
+  measure(scenario, "draw_sprites", n, restore,
+          [&] { draw_sprites(ecs, world.drawn); });
+  // Nothing is filed yet, so this files every entity, as on the frame they
+  // spawn.
+  measure(scenario, "chunk_tracking", n, restore,
+          [&] { chunk_tracking(ecs, world.tracked); });
+}
+
+/* scenarios */
+
+void add_zombie_ring(World &world, int n) {
+  for (int i = 0; i < n; ++i) {
+    Vec3 offset = {random_fix(2 * SCREEN_WIDTH) - SCREEN_WIDTH,
+                   random_fix(2 * SCREEN_WIDTH) - SCREEN_WIDTH, {0}};
+    normalizef32(reinterpret_cast<int32 *>(&offset));
+    const nds::fix radius = nds::fix::from_int(SCREEN_WIDTH);
+    world.add_zombie({SCREEN_CENTRE.x + offset.x * radius,
+                      SCREEN_CENTRE.y + offset.y * radius, {0}});
+  }
+}
+
+// N zombies in a ring around the player, having walked in to meet it.
+void converge(Sprites &sprites, int n) {
+  srand(n);
+  World world{sprites};
+  add_zombie_ring(world, n);
+  const auto steps = static_cast<int32_t>(FIX_SCREEN_WIDTH / ZOMBIE_SPEED);
+  for (int32_t step = 0; step < steps; ++step) {
+    FollowingAi::run(world.ecs, world.following);
+    ApplyVelocity::run(world.ecs, world.moving);
+  }
+  measure_systems("converge", n, world);
+}
+
+// N fireballs flying right, across a crowd of N zombies.
+void fireballs(Sprites &sprites, int n) {
+  srand(n);
+  World world{sprites};
+  for (int i = 0; i < n; ++i) {
+    world.add_zombie(
+        {random_fix(SCREEN_WIDTH), random_fix(SCREEN_HEIGHT), {0}});
+  }
+  for (int i = 0; i < n; ++i) {
+    const nds::fix y = random_fix(SCREEN_HEIGHT);
+    world.add_fireball({{0}, y, {0}}, {FIX_SCREEN_WIDTH, y, {0}});
+  }
+  measure_systems("fireballs", n, world);
+}
+
+// An explosion in the middle of a crowd of N zombies.
+void explosion(Sprites &sprites, int n) {
+  srand(n);
+  World world{sprites};
+  for (int i = 0; i < n; ++i) {
+    world.add_zombie({SCREEN_CENTRE.x + random_fix(64) - 32,
+                      SCREEN_CENTRE.y + random_fix(64) - 32, {0}});
+  }
+  world.add_explosion(SCREEN_CENTRE);
+  measure_systems("explosion", n, world);
+}
+
+// N particles (up to the pool's capacity) bursting out of the middle of the
+// screen.
+void particles(Sprites &sprites, int n) {
+  World world{sprites};
+  ParticleSprites particle_sprites{&oamMain, sprites.fireball};
+  particle_sprites.reserve(sprite_id_manager);
+  sprite_sorter.reset(sprite_id_manager);
+  const int count = std::min<int>(n, PARTICLE_CAPACITY);
+  const auto burst = [&] {
+    particle_pool.clear();
+    emit_burst(particle_pool, SCREEN_CENTRE, count,
+               nds::fix::from_float(3.0f), UINT16_MAX);
+  };
+  measure("particles", "update_particles", n, burst,
+          [&] { update_particles(particle_pool); });
+  measure("particles", "draw_particles", n, burst, [&] {
+    draw_particles(particle_pool, particle_sprites, camera);
+  });
+  measure("particles", "emit_burst", n, burst);
+}
+
+void factories(Sprites &sprites, int n) {
+  srand(n);
+  std::vector<Vec3> positions(n);
+  for (Vec3 &position : positions) {
+    position = {random_fix(SCREEN_WIDTH), random_fix(SCREEN_HEIGHT), {0}};
+  }
+
+  std::optional<World> world;
+  const auto fresh_world = [&] { world.emplace(sprites); };
+  measure("factories", "make_zombie", n, fresh_world, [&] {
+    for (const Vec3 &position : positions) {
+      make_zombie(world->ecs, position, world->player, ZOMBIE_SPEED,
+                  sprite_id_manager, sprites.zombie);
+    }
+  });
+  measure("factories", "make_fireball", n, fresh_world, [&] {
+    for (const Vec3 &position : positions) {
+      make_fireball(world->ecs, SCREEN_CENTRE, position, sprite_id_manager,
+                    sprites.fireball);
+    }
+  });
+}
+
+// The converge scenario run as main() runs the game: a fixed simulation step
+// per VBlank, catching up after late frames.
+void pacing(Sprites &sprites, int n) {
+  srand(n);
+  World world{sprites};
+  add_zombie_ring(world, n);
+  Coordinator &ecs = world.ecs;
+
+  frame::Pacer pacer;
+  frame::start();
+  pacer.resync();
+  const auto deadline = Clock::now() + PACING_DURATION;
+  while (pacer.pacing().frames < PACING_FRAMES and Clock::now() < deadline) {
+    const int steps = pacer.wait();
+    for (int step = 0; step < steps; ++step) {
+      FollowingAi::run(ecs, world.following);
+      ApplyVelocity::run(ecs, world.moving);
+      circular_collision_detection(ecs, world.colliding);
+    }
+    draw_sprites(ecs, world.drawn);
+    frame::present();
+  }
+  // Lateness is counted by the wait after a frame.
+  pacer.wait();
+  frame::stop();
+
+  const frame::Pacing &result = pacer.pacing();
+  const std::pair<const char *, uint32_t> rows[] = {
+      {"frames", result.frames},
+      {"frames_late", result.late},
+      {"frames_skipped", result.skipped},
+      {"steps_dropped", result.dropped_steps},
+  };
+  for (const auto &[name, value] : rows) {
+    fprintf(stderr, "pacing/%d,%s,%lu,%.3f\n", n, name,
+            static_cast<unsigned long>(value),
+            static_cast<double>(value) / result.frames);
+  }
+}
+
+// Keeps the compiler from discarding the arithmetic.
+volatile int32_t sink;
+
+void fixed_point(int n) {
+  srand(n);
+  std::vector<nds::fix> a(n);
+  std::vector<nds::fix> b(n);
+  for (int i = 0; i < n; ++i) {
+    a[i] = nds::fix{rand() % inttof32(64) - inttof32(32)};
+    // Keep the divisors away from zero.
+    b[i] = nds::fix{rand() % inttof32(32) + inttof32(1)};
+  }
+
+  const auto reduce = [&](auto op) {
+    nds::fix total{0};
+    for (int i = 0; i < n; ++i) {
+      total += op(a[i], b[i]);
+    }
+    sink = total.bits;
+  };
+  measure("fix", "operator*", n,
+          [&] { reduce([](nds::fix x, nds::fix y) { return x * y; }); });
+  measure("fix", "operator/", n,
+          [&] { reduce([](nds::fix x, nds::fix y) { return x / y; }); });
+  measure("fix", "operator+", n,
+          [&] { reduce([](nds::fix x, nds::fix y) { return x + y; }); });
+  measure("fix", "sqrt", n, [&] {
+    reduce([](nds::fix, nds::fix y) { return nds::fix::sqrt(y); });
+  });
+}
+
+// The batch kernels, against the same work done with fix's operators.
+void kernels(int n) {
+  srand(n);
+  std::vector<nds::fix> x(n);
+  std::vector<nds::fix> y(n);
+  std::vector<nds::fix> vx(n);
+  std::vector<nds::fix> vy(n);
+  std::vector<nds::fix> out_x(n);
+  std::vector<nds::fix> out_y(n);
+  std::vector<nds::fix> distances(n);
+  for (int i = 0; i < n; ++i) {
+    x[i] = random_fix(SCREEN_WIDTH);
+    y[i] = random_fix(SCREEN_HEIGHT);
+    vx[i] = nds::fix{rand() % inttof32(4) - inttof32(2)};
+    vy[i] = nds::fix{rand() % inttof32(4) - inttof32(2)};
+  }
+  const nds::fix drag = nds::fix::from_float(0.875f);
+  // Start each run from the same positions, so they can't overflow.
+  const std::vector<nds::fix> x0 = x;
+  const std::vector<nds::fix> y0 = y;
+  const auto restart = [&] {
+    x = x0;
+    y = y0;
+  };
+
+  measure("kernels", "integrate", n, restart, [&] {
+    nds::kernels::integrate(x.data(), vx.data(), n);
+    nds::kernels::integrate(y.data(), vy.data(), n);
+  });
+  measure("kernels", "integrate_scalar", n, restart, [&] {
+    for (int i = 0; i < n; ++i) {
+      x[i] += vx[i];
+      y[i] += vy[i];
+    }
+  });
+  measure("kernels", "scale", n, [&] {
+    nds::kernels::scale(out_x.data(), vx.data(), drag, n);
+    nds::kernels::scale(out_y.data(), vy.data(), drag, n);
+  });
+  measure("kernels", "scale_scalar", n, [&] {
+    for (int i = 0; i < n; ++i) {
+      out_x[i] = vx[i] * drag;
+      out_y[i] = vy[i] * drag;
+    }
+  });
+  measure("kernels", "distance_squared", n, [&] {
+    nds::kernels::distance_squared(distances.data(), x.data(), y.data(),
+                                   SCREEN_CENTRE.x, SCREEN_CENTRE.y, n);
+  });
+  measure("kernels", "distance_squared_scalar", n, [&] {
+    for (int i = 0; i < n; ++i) {
+      const nds::fix dx = x[i] - SCREEN_CENTRE.x;
+      const nds::fix dy = y[i] - SCREEN_CENTRE.y;
+      distances[i] = dx * dx + dy * dy;
+    }
+  });
+  sink = out_x[n - 1].bits + out_y[n - 1].bits + distances[n - 1].bits +
+         x[n - 1].bits;
+}
+
+#ifdef MAGIC_BATTLE_PARALLEL
+// The converge scenario's range systems on one thread, then on the pool.
+// Returns whether both moved every zombie to the same place.
+bool parallel(Sprites &sprites, int n) {
+  const std::size_t workers = scheduler::workers();
+  std::vector<Vec3> positions[2];
+  for (int run = 0; run < 2; ++run) {
+    scheduler::set_workers(run == 0 ? 0 : workers);
+    srand(n);
+    World world{sprites};
+    add_zombie_ring(world, n);
+    Coordinator &ecs = world.ecs;
+    const auto step = [&] {
+      FollowingAi::run(ecs, world.following);
+      ApplyVelocity::run(ecs, world.moving);
+    };
+    for (int i = 0; i < 60; ++i) {
+      step();
+    }
+    for (const Entity entity : world.moving) {
+      positions[run].push_back(ecs.getComponent<Position>(entity).pos);
+    }
+    measure("parallel", run == 0 ? "step_serial" : "step_parallel", n, step);
+  }
+  return std::equal(positions[0].begin(), positions[0].end(),
+                    positions[1].begin(), positions[1].end(),
+                    [](const Vec3 &a, const Vec3 &b) {
+                      return a.x.bits == b.x.bits and a.y.bits == b.y.bits;
+                    });
+}
+
+// The cleanup pipeline on one thread, then on the pool, reclaiming N marked
+// zombies. Its systems don't conflict, so they run at once. Returns whether
+// both freed every sprite slot and emptied every chunk.
+bool parallel_cleanup(Sprites &sprites, int n) {
+  static_assert(CleanupPipeline::schedule::wave_count < CleanupPipeline::size,
+                "The cleanup pipeline has no wave of systems to run at once.");
+  const std::size_t workers = scheduler::workers();
+  bool ok = true;
+  std::optional<World> world;
+  const auto marked_world = [&] {
+    srand(n);
+    world.emplace(sprites);
+    add_zombie_ring(*world, n);
+    chunk_tracking(world->ecs, world->tracked);
+    for (const Entity entity : world->tracked) {
+      add_components(world->ecs, entity, DeathMark{});
+    }
+  };
+  for (int run = 0; run < 2; ++run) {
+    scheduler::set_workers(run == 0 ? 0 : workers);
+    measure("parallel", run == 0 ? "cleanup_serial" : "cleanup_parallel", n,
+            marked_world, [&] {
+              world->cleanup.run(world->ecs);
+              world->ecs.destroyQueued();
+            });
+    ok = ok and sprite_id_manager.ids.in_use() == 0 and
+         world_chunks.population() == 0;
+  }
+  return ok;
+}
+#endif
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<int> sizes;
+  for (int i = 1; i < argc; ++i) {
+    sizes.push_back(atoi(argv[i]));
+  }
+  if (sizes.empty()) {
+    sizes.assign(std::begin(DEFAULT_SIZES), std::end(DEFAULT_SIZES));
+  }
+
+  if (not nds::kernels::verify()) {
+    fprintf(stderr, "Batch kernels don't match the portable loops.\n");
+    return 1;
+  }
+
+  Sprites sprites;
+  print_header();
+  for (const int n : sizes) {
+    converge(sprites, n);
+    fireballs(sprites, n);
+    explosion(sprites, n);
+    particles(sprites, n);
+    factories(sprites, n);
+    pacing(sprites, n);
+    fixed_point(n);
+    kernels(n);
+#ifdef MAGIC_BATTLE_PARALLEL
+    if (not parallel(sprites, n) or not parallel_cleanup(sprites, n)) {
+      fprintf(stderr, "Parallel systems don't match serial ones.\n");
+      return 1;
+    }
+#endif
+  }
+}
@@ -0,0 +1,13 @@
+#ifndef HOST_MAXMOD9_H
+#define HOST_MAXMOD9_H
+
+typedef unsigned int mm_word;
+typedef unsigned int mm_sfxhand;
+
+// Sound is dropped.
+inline mm_sfxhand mmEffect(mm_word sample_ID) {
+  static_cast<void>(sample_ID);
+  return 0;
+}
+
+#endif /* HOST_MAXMOD9_H */
@@ -0,0 +1,45 @@
+// Host stand-in for the parts of libnds the game logic uses, so it can be
+// built and benchmarked on a PC. Hardware is emulated only as far as the
+// benchmarks need: OAM is a plain array, the timer is the system clock.
+#ifndef HOST_NDS_H
+#define HOST_NDS_H
+
+#include <nds/ndstypes.h>
+
+#include <nds/arm9/background.h>
+#include <nds/arm9/cache.h>
+#include <nds/arm9/math.h>
+#include <nds/arm9/sprite.h>
+#include <nds/arm9/video.h>
+#include <nds/dma.h>
+#include <nds/timers.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+/* interrupts */
+inline void swiWaitForVBlank() {}
+
+/* input: there is no player, so START is always pressed. */
+enum KEYPAD_BITS {
+  KEY_A = 1 << 0,
+  KEY_B = 1 << 1,
+  KEY_SELECT = 1 << 2,
+  KEY_START = 1 << 3,
+  KEY_RIGHT = 1 << 4,
+  KEY_LEFT = 1 << 5,
+  KEY_UP = 1 << 6,
+  KEY_DOWN = 1 << 7,
+  KEY_R = 1 << 8,
+  KEY_L = 1 << 9,
+  KEY_X = 1 << 10,
+  KEY_Y = 1 << 11,
+  KEY_TOUCH = 1 << 12,
+};
+
+inline void scanKeys() {}
+inline uint32_t keysDown() { return KEY_START; }
+inline uint32_t keysCurrent() { return 0; }
+
+#endif /* HOST_NDS_H */
@@ -0,0 +1,12 @@
+#ifndef HOST_NDS_ARM9_BACKGROUND_H
+#define HOST_NDS_ARM9_BACKGROUND_H
+
+// Backgrounds aren't drawn on the host.
+inline void bgSetScroll(int id, int x, int y) {
+  static_cast<void>(id);
+  static_cast<void>(x);
+  static_cast<void>(y);
+}
+inline void bgUpdate() {}
+
+#endif /* HOST_NDS_ARM9_BACKGROUND_H */
@@ -0,0 +1,12 @@
+#ifndef HOST_NDS_ARM9_CACHE_H
+#define HOST_NDS_ARM9_CACHE_H
+
+#include <nds/ndstypes.h>
+
+// The host has no DMA to keep coherent with the cache.
+inline void DC_FlushRange(const void *base, u32 size) {
+  static_cast<void>(base);
+  static_cast<void>(size);
+}
+
+#endif /* HOST_NDS_ARM9_CACHE_H */
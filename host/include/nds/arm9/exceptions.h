@@ -0,0 +1,3 @@
+#ifndef HOST_NDS_ARM9_EXCEPTIONS_H
+#define HOST_NDS_ARM9_EXCEPTIONS_H
+#endif /* HOST_NDS_ARM9_EXCEPTIONS_H */
@@ -0,0 +1,46 @@
+// 20.12 fixed-point helpers, with the rounding of the DS's math hardware.
+#ifndef HOST_NDS_ARM9_MATH_H
+#define HOST_NDS_ARM9_MATH_H
+
+#include <nds/ndstypes.h>
+
+#define inttof32(n) ((n) * (1 << 12))
+#define f32toint(n) ((n) >> 12)
+#define floattof32(n) ((int)((n) * (1 << 12)))
+#define f32tofloat(n) (((float)(n)) / (float)(1 << 12))
+
+inline int32 mulf32(int32 a, int32 b) {
+  return static_cast<int32>((static_cast<int64_t>(a) * b) >> 12);
+}
+
+// The divider truncates towards zero, and gives +/-1 with the opposite sign to
+// the numerator when dividing by zero.
+inline int32 divf32(int32 num, int32 den) {
+  if (den == 0) {
+    return num < 0 ? 1 : -1;
+  }
+  return static_cast<int32>((static_cast<int64_t>(num) << 12) / den);
+}
+
+// The square root unit takes the floor of an unsigned root.
+inline int32 sqrtf32(int32 a) {
+  const uint64_t n = static_cast<uint64_t>(static_cast<uint32_t>(a)) << 12;
+  // Newton's method from above converges on the floor.
+  uint64_t x = n;
+  uint64_t y = (x + 1) / 2;
+  while (y < x) {
+    x = y;
+    y = (x + n / x) / 2;
+  }
+  return static_cast<int32>(x);
+}
+
+inline void normalizef32(int32 *a) {
+  const int32 magnitude =
+      sqrtf32(mulf32(a[0], a[0]) + mulf32(a[1], a[1]) + mulf32(a[2], a[2]));
+  a[0] = divf32(a[0], magnitude);
+  a[1] = divf32(a[1], magnitude);
+  a[2] = divf32(a[2], magnitude);
+}
+
+#endif /* HOST_NDS_ARM9_MATH_H */
@@ -0,0 +1,68 @@
+#ifndef HOST_NDS_ARM9_SPRITE_H
+#define HOST_NDS_ARM9_SPRITE_H
+
+#include <nds/ndstypes.h>
+
+#define SPRITE_COUNT 128
+#define MATRIX_COUNT 32
+
+// Encoded as in libnds: OAM size and shape bits, and the size in 32-byte units.
+enum SpriteSize {
+  SpriteSize_8x8 = (0 << 14) | (0 << 12) | (8 * 8 >> 5),
+  SpriteSize_16x16 = (1 << 14) | (0 << 12) | (16 * 16 >> 5),
+  SpriteSize_32x32 = (2 << 14) | (0 << 12) | (32 * 32 >> 5),
+  SpriteSize_64x64 = (3 << 14) | (0 << 12) | (64 * 64 >> 5),
+  SpriteSize_16x8 = (0 << 14) | (1 << 12) | (16 * 8 >> 5),
+  SpriteSize_32x8 = (1 << 14) | (1 << 12) | (32 * 8 >> 5),
+  SpriteSize_32x16 = (2 << 14) | (1 << 12) | (32 * 16 >> 5),
+  SpriteSize_64x32 = (3 << 14) | (1 << 12) | (64 * 32 >> 5),
+  SpriteSize_8x16 = (0 << 14) | (2 << 12) | (8 * 16 >> 5),
+  SpriteSize_8x32 = (1 << 14) | (2 << 12) | (8 * 32 >> 5),
+  SpriteSize_16x32 = (2 << 14) | (2 << 12) | (16 * 32 >> 5),
+  SpriteSize_32x64 = (3 << 14) | (2 << 12) | (32 * 64 >> 5),
+};
+
+#define SPRITE_SIZE_PIXELS(size) (((size) & 0xFFF) << 5)
+
+enum SpriteColorFormat {
+  SpriteColorFormat_16Color,
+  SpriteColorFormat_256Color,
+};
+
+typedef u16 _ext_palette[16][256];
+
+struct SpriteEntry {
+  int x;
+  int y;
+  int priority;
+  int palette_alpha;
+  SpriteSize size;
+  SpriteColorFormat format;
+  const void *gfx;
+  bool hidden;
+};
+
+struct OamState {
+  SpriteEntry oamMemory[SPRITE_COUNT];
+};
+
+extern OamState oamMain;
+
+// The hardware OAM, which the shadow in oamMain is copied to.
+extern SpriteEntry host_oam[SPRITE_COUNT];
+#define OAM host_oam
+
+void oamSet(OamState *oam, int id, int x, int y, int priority,
+            int palette_alpha, SpriteSize size, SpriteColorFormat format,
+            const void *gfx, int affineIndex, bool sizeDouble, bool hide,
+            bool hflip, bool vflip, bool mosaic);
+void oamSetHidden(OamState *oam, int id, bool hide);
+void oamSetXY(OamState *oam, int id, int x, int y);
+void oamClearSprite(OamState *oam, int id);
+void oamClear(OamState *oam, int start, int count);
+void oamUpdate(OamState *oam);
+void oamRotateScale(OamState *oam, int rotId, int angle, int sx, int sy);
+u16 *oamAllocateGfx(OamState *oam, SpriteSize size, SpriteColorFormat format);
+void oamFreeGfx(OamState *oam, const void *gfx);
+
+#endif /* HOST_NDS_ARM9_SPRITE_H */
@@ -0,0 +1,7 @@
+#ifndef HOST_NDS_ARM9_VIDEO_H
+#define HOST_NDS_ARM9_VIDEO_H
+
+#define SCREEN_WIDTH 256
+#define SCREEN_HEIGHT 192
+
+#endif /* HOST_NDS_ARM9_VIDEO_H */
@@ -0,0 +1,11 @@
+#ifndef HOST_NDS_DMA_H
+#define HOST_NDS_DMA_H
+
+#include <cstring>
+#include <nds/ndstypes.h>
+
+inline void dmaCopy(const void *source, void *dest, u32 size) {
+  std::memcpy(dest, source, size);
+}
+
+#endif /* HOST_NDS_DMA_H */
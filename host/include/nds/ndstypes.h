@@ -0,0 +1,14 @@
+#ifndef HOST_NDS_NDSTYPES_H
+#define HOST_NDS_NDSTYPES_H
+
+#include <cstdint>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int32_t int32;
+
+#endif /* HOST_NDS_NDSTYPES_H */
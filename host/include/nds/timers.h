@@ -0,0 +1,13 @@
+#ifndef HOST_NDS_TIMERS_H
+#define HOST_NDS_TIMERS_H
+
+#include <nds/ndstypes.h>
+
+#define BUS_CLOCK (33513982)
+
+// Ticks of BUS_CLOCK, from the system clock.
+void cpuStartTiming(int timer);
+u32 cpuGetTiming();
+u32 cpuEndTiming();
+
+#endif /* HOST_NDS_TIMERS_H */
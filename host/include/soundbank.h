@@ -0,0 +1,10 @@
+// Normally generated by mmutil from the sounds in CMakeLists.txt.
+#ifndef HOST_SOUNDBANK_H
+#define HOST_SOUNDBANK_H
+
+#define SFX_EXPLOSION 0
+#define SFX_TELEPORT 1
+#define SFX_HIT 2
+#define SFX_FIREBALL 3
+
+#endif /* HOST_SOUNDBANK_H */
@@ -0,0 +1,83 @@
+#include <chrono>
+#include <nds.h>
+
+OamState oamMain;
+SpriteEntry host_oam[SPRITE_COUNT];
+
+void oamSet(OamState *oam, int id, int x, int y, int priority,
+            int palette_alpha, SpriteSize size, SpriteColorFormat format,
+            const void *gfx, int affineIndex, bool sizeDouble, bool hide,
+            bool hflip, bool vflip, bool mosaic) {
+  static_cast<void>(affineIndex);
+  static_cast<void>(sizeDouble);
+  static_cast<void>(hflip);
+  static_cast<void>(vflip);
+  static_cast<void>(mosaic);
+  oam->oamMemory[id] = {x, y, priority, palette_alpha, size, format, gfx, hide};
+}
+
+void oamSetHidden(OamState *oam, int id, bool hide) {
+  oam->oamMemory[id].hidden = hide;
+}
+
+void oamSetXY(OamState *oam, int id, int x, int y) {
+  oam->oamMemory[id].x = x;
+  oam->oamMemory[id].y = y;
+}
+
+void oamClearSprite(OamState *oam, int id) {
+  oam->oamMemory[id] = {};
+  oam->oamMemory[id].hidden = true;
+}
+
+void oamClear(OamState *oam, int start, int count) {
+  for (int id = start; id < start + count and id < SPRITE_COUNT; ++id) {
+    oamClearSprite(oam, id);
+  }
+}
+
+void oamUpdate(OamState *oam) { static_cast<void>(oam); }
+
+void oamRotateScale(OamState *oam, int rotId, int angle, int sx, int sy) {
+  static_cast<void>(oam);
+  static_cast<void>(rotId);
+  static_cast<void>(angle);
+  static_cast<void>(sx);
+  static_cast<void>(sy);
+}
+
+// Sprite VRAM is a bump allocator over a buffer the size of banks A and B.
+static u16 sprite_vram[2 * 128 * 1024 / sizeof(u16)];
+static std::size_t sprite_vram_used;
+
+u16 *oamAllocateGfx(OamState *oam, SpriteSize size, SpriteColorFormat format) {
+  static_cast<void>(oam);
+  const std::size_t bytes =
+      SPRITE_SIZE_PIXELS(size) * (format == SpriteColorFormat_16Color ? 1 : 2) /
+      2;
+  assert(sprite_vram_used + bytes <= sizeof(sprite_vram));
+  u16 *gfx = sprite_vram + sprite_vram_used / sizeof(u16);
+  sprite_vram_used += bytes;
+  return gfx;
+}
+
+void oamFreeGfx(OamState *oam, const void *gfx) {
+  static_cast<void>(oam);
+  static_cast<void>(gfx);
+}
+
+using Clock = std::chrono::steady_clock;
+static Clock::time_point timing_start = Clock::now();
+
+void cpuStartTiming(int timer) {
+  static_cast<void>(timer);
+  timing_start = Clock::now();
+}
+
+u32 cpuGetTiming() {
+  const std::chrono::duration<double> elapsed = Clock::now() - timing_start;
+  // Wraps like the hardware's 32-bit counter.
+  return static_cast<u32>(static_cast<uint64_t>(elapsed.count() * BUS_CLOCK));
+}
+
+u32 cpuEndTiming() { return cpuGetTiming(); }
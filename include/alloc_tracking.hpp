@@ -0,0 +1,116 @@
+#ifndef ALLOC_TRACKING_H
+#define ALLOC_TRACKING_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Heap allocations, per frame, attributed to where they happened: the phase
+// of the frame main() is in, and the system running, if any. On the DS,
+// malloc, free, realloc and calloc are wrapped at link time, which catches
+// operator new too; on the host, operator new and delete are replaced.
+//
+// With MAGIC_BATTLE_ALLOC_STRICT as well, the game should allocate nothing
+// once a round has warmed up: any allocation WARM_UP_FRAMES after reset()
+// prints where it happened and aborts.
+//
+// Everything here compiles to nothing unless MAGIC_BATTLE_ALLOC_TRACKING is
+// defined (ALLOC_TRACKING=1 or ALLOC_TRACKING=strict with make,
+// -DMAGIC_BATTLE_ALLOC_TRACKING=ON and -DMAGIC_BATTLE_ALLOC_STRICT=ON with
+// CMake).
+namespace alloc {
+
+// Frames after reset() before strict mode starts failing allocations.
+constexpr uint32_t WARM_UP_FRAMES = 60;
+// Phase and system pairs counted separately. Later ones are only totalled.
+constexpr std::size_t MAX_SITES = 32;
+
+struct Site {
+  // Set by phase(), or nullptr before the first call.
+  const char *phase;
+  // A Pipeline System's name, or nullptr outside of one.
+  const char *system;
+  uint32_t allocations;
+  uint32_t bytes;
+};
+
+struct Frame {
+  uint32_t allocations = 0;
+  uint32_t frees = 0;
+  uint32_t bytes = 0;
+  // Most heap in use at once.
+  uint32_t peak_bytes = 0;
+  std::array<Site, MAX_SITES> sites{};
+  std::size_t site_count = 0;
+};
+
+#ifdef MAGIC_BATTLE_ALLOC_TRACKING
+
+// Attribute allocations from here on to phase, a string literal.
+void phase(const char *name);
+
+// Attribute allocations on this thread to a system while it runs.
+class SystemScope {
+public:
+  explicit SystemScope(const char *name);
+  ~SystemScope();
+  SystemScope(const SystemScope &) = delete;
+  SystemScope &operator=(const SystemScope &) = delete;
+
+private:
+  const char *outer;
+};
+
+// Allocations while one of these is alive don't fail strict mode: for
+// things the player asked for, like restoring a save state.
+class Exempt {
+public:
+  Exempt();
+  ~Exempt();
+  Exempt(const Exempt &) = delete;
+  Exempt &operator=(const Exempt &) = delete;
+};
+
+void end_frame();
+// Clear the counts and restart the warm-up. Strict mode is off until it ends.
+void reset();
+// Stop strict mode until the next reset().
+void relax();
+
+const Frame &last_frame();
+// Every frame since reset().
+const Frame &totals();
+uint32_t frames();
+// Heap in use now, as the allocator counts it.
+std::size_t live_bytes();
+
+// One screen of the last frame's allocations, for the console HUD.
+void print_frame();
+// The totals as CSV rows: label,phase/system,allocations,bytes
+void dump(FILE *file, const char *label);
+
+#else
+
+inline void phase(const char *) {}
+
+struct SystemScope {
+  explicit SystemScope(const char *) {}
+};
+struct Exempt {
+  Exempt() {}
+};
+
+inline void end_frame() {}
+inline void reset() {}
+inline void relax() {}
+inline void print_frame() {
+  printf("Built without MAGIC_BATTLE_ALLOC_TRACKING.\n");
+}
+inline void dump(FILE *, const char *) {}
+
+#endif
+
+} // namespace alloc
+
+#endif /* ALLOC_TRACKING_H */
@@ -0,0 +1,85 @@
+#ifndef BITMAP_ID_MANAGER_H
+#define BITMAP_ID_MANAGER_H
+
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Hands out the IDs 0 to N-1.
+// Each ID has a bit in a word of the free map (set = free), and each word has a
+// bit in the summary (set = the word has a free ID), so allocate() and
+// release() cost two count-trailing-zeros regardless of occupancy.
+template <typename T, std::size_t N> class BitmapIdManager {
+  static_assert(N > 0 and N <= 32 * 32, "The summary word covers 1024 IDs.");
+  static constexpr std::size_t WORDS = (N + 31) / 32;
+
+  std::array<uint32_t, WORDS> free_{};
+  uint32_t summary_ = 0;
+  std::size_t in_use_ = 0;
+  std::size_t peak_ = 0;
+  std::size_t failures_ = 0;
+
+  static constexpr uint32_t low_bits(std::size_t count) {
+    return count >= 32 ? ~uint32_t{0} : (uint32_t{1} << count) - 1;
+  }
+
+public:
+  constexpr BitmapIdManager() { reset(); }
+
+  // Free every ID and clear the occupancy counters.
+  constexpr void reset() {
+    for (std::size_t word = 0; word < WORDS; ++word) {
+      free_[word] = low_bits(N - word * 32);
+    }
+    summary_ = low_bits(WORDS);
+    in_use_ = 0;
+    peak_ = 0;
+    failures_ = 0;
+  }
+
+  // The lowest free ID, or nothing if they are all in use.
+  constexpr std::optional<T> allocate() {
+    if (summary_ == 0) {
+      ++failures_;
+      return std::nullopt;
+    }
+    const int word = std::countr_zero(summary_);
+    const int bit = std::countr_zero(free_[word]);
+    // Clear the lowest set bit.
+    free_[word] &= free_[word] - 1;
+    if (free_[word] == 0) {
+      summary_ &= ~(uint32_t{1} << word);
+    }
+    if (++in_use_ > peak_) {
+      peak_ = in_use_;
+    }
+    return static_cast<T>(word * 32 + bit);
+  }
+
+  constexpr void release(T id) {
+    const auto index = static_cast<std::size_t>(id);
+    assert(index < N and allocated(id));
+    free_[index / 32] |= uint32_t{1} << (index % 32);
+    summary_ |= uint32_t{1} << (index / 32);
+    --in_use_;
+  }
+
+  constexpr bool allocated(T id) const {
+    const auto index = static_cast<std::size_t>(id);
+    return (free_[index / 32] & (uint32_t{1} << (index % 32))) == 0;
+  }
+
+  /* occupancy */
+  static constexpr std::size_t capacity() { return N; }
+  constexpr std::size_t in_use() const { return in_use_; }
+  constexpr std::size_t available() const { return N - in_use_; }
+  // Most IDs in use at once since the last reset().
+  constexpr std::size_t peak() const { return peak_; }
+  // allocate() calls that found nothing free since the last reset().
+  constexpr std::size_t failures() const { return failures_; }
+};
+
+#endif /* BITMAP_ID_MANAGER_H */
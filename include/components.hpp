@@ -1,10 +1,12 @@
 #ifndef COMPONENTS_H
 #define COMPONENTS_H
 #include "ndspp.hpp"
+#include "stats.hpp"
 #include "tecs.hpp"
 #include <bitset>
 #include <cstdint>
 #include <functional>
+#include <utility>
 
 struct Vec3 {
   nds::fix x;
@@ -26,12 +28,18 @@ struct Affine {
   int32_t scale;
 };
 
+struct SpriteData;
+
 struct SpriteInfo {
+  // Sprite slot, or NO_SPRITE if the entity is waiting for one or was
+  // evicted. draw_sprites picks the OAM entry each frame, in depth order.
   int id;
   // Width divided by 2
   nds::fix width2;
   // Height divided by 2
   nds::fix height2;
+  // Graphics to (re)attach when the entity is given a slot.
+  SpriteData *sprite;
 };
 
 struct Zombie {};
@@ -41,12 +49,23 @@ struct Following {
   nds::fix speed;
 };
 
-struct RenderingSystemTag {};
+struct SnapshotSystemTag {};
+
+constexpr int16_t NO_CHUNK = -1;
+
+// The world chunk an entity is filed under, or NO_CHUNK if it hasn't been yet.
+struct ChunkCell {
+  int16_t chunk;
+};
 
-struct PhysicsSystemTag {};
+// On entities in chunks near the player. The others are asleep.
+struct Awake {};
 
-struct AdminSystemTag {};
-struct CleanupSystemTag {};
+// Leaves a particle behind every period frames.
+struct ParticleTrail {
+  uint8_t period;
+  uint8_t clock;
+};
 
 struct DeathMark {};
 
@@ -72,4 +91,18 @@ enum CollisionLayers {
   PLAYER_ATTACK_LAYER = 1 << 2,
 };
 
+// Coordinator::getComponent, counted as a component lookup.
+template <typename T> T &lookup(Tecs::Coordinator &ecs, Tecs::Entity entity) {
+  STAT_INC(ComponentLookups);
+  return ecs.getComponent<T>(entity);
+}
+
+// Coordinator::addComponents, counted as a structural change per component.
+template <typename... Ts>
+auto add_components(Tecs::Coordinator &ecs, Tecs::Entity entity,
+                    Ts... components) {
+  STAT_ADD(StructuralChanges, sizeof...(Ts));
+  return ecs.addComponents(entity, std::move(components)...);
+}
+
 #endif /* COMPONENTS_H */
@@ -0,0 +1,94 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <cstdint>
+
+// Simulation and presentation, decoupled.
+//
+// The game simulates a frame, writing sprites to oamMain's shadow OAM as
+// usual, then present()s it: the shadow OAM, queued VRAM uploads and
+// background scroll are copied to a back buffer that the VBlank interrupt
+// commits to the hardware. Simulation of the next frame starts straight
+// away, during scan-out of the last one.
+//
+// The Pacer keeps simulation at one fixed step per VBlank: after a slow frame
+// it asks for extra steps to catch up, skipping the frames that would have
+// shown them.
+namespace frame {
+
+// Most simulation steps per presented frame. Past this the game slows down
+// rather than catch up.
+constexpr int MAX_CATCH_UP = 4;
+// Most VRAM uploads queued per frame. More are copied straight away.
+constexpr int MAX_UPLOADS = 16;
+
+// Install the VBlank handler. Until then, and after stop(), uploads and
+// scrolling happen immediately.
+void start();
+void stop();
+
+// Copy size bytes to VRAM at the next commit. source must stay valid until
+// then.
+void upload(void *destination, const void *source, uint32_t size);
+// Set a background's scroll at the next commit.
+void scroll(int background, int x, int y);
+// Hand this frame's shadow OAM and queued work to the next VBlank.
+void present();
+
+// VBlanks since start().
+uint32_t vblanks();
+
+// When input was read: cpuGetTiming() ticks and vblanks().
+struct InputStamp {
+  uint32_t tick;
+  uint32_t vblank;
+};
+InputStamp stamp_input();
+
+// Input-to-display latency: from when input was read to when the frame
+// showing its result was committed, which is the start of its scan-out.
+struct Latency {
+  uint32_t samples;
+  uint32_t last_frames;
+  uint32_t max_frames;
+  uint32_t last_us;
+  uint32_t max_us;
+  uint64_t total_us;
+};
+
+// Mark the frame being built as the one showing the result of input. Its
+// commit adds a latency sample. Only the earliest input in a frame counts.
+void mark_input(InputStamp input);
+const Latency &latency();
+void reset_latency();
+
+struct Pacing {
+  // Frames started by wait().
+  uint32_t frames;
+  // Frames that missed their VBlank, counted by the wait() after them.
+  uint32_t late;
+  // VBlanks that showed an old frame again.
+  uint32_t skipped;
+  // Steps not simulated because they were past MAX_CATCH_UP.
+  uint32_t dropped_steps;
+};
+
+class Pacer {
+public:
+  // Wait until the last presented frame is committed and at least one
+  // VBlank has passed since the last wait, then return how many simulation
+  // steps to run before presenting again.
+  int wait();
+  // Forget the VBlanks since the last wait, e.g. after pausing.
+  void resync();
+
+  const Pacing &pacing() const { return pacing_; }
+
+private:
+  uint32_t last_vblank = 0;
+  Pacing pacing_{};
+};
+
+} // namespace frame
+
+#endif /* FRAME_PIPELINE_H */
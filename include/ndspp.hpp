@@ -3,6 +3,7 @@
 
 #include "nds/arm9/math.h"
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
 
 namespace nds {
@@ -67,6 +68,44 @@ inline bool operator>(const fix &lhs, const fix &rhs) { return rhs < lhs; }
 inline bool operator<=(const fix &lhs, const fix &rhs) { return !(lhs > rhs); }
 inline bool operator>=(const fix &lhs, const fix &rhs) { return !(lhs < rhs); }
 
+/* batch kernels */
+
+// Fixed-point maths over whole arrays, for hot loops that have gathered their
+// data into contiguous arrays, one per axis. On the DS they're hand-written ARM
+// (source/ndspp_kernels.s) using the ARM946E-S's long multiplies and
+// saturating adds. Elsewhere they're the portable loops. The compiler
+// vectorises add and integrate, but scale and distance_squared need 64-bit
+// products and shifts, so they go one element at a time, no faster than fix's
+// operators. Both give the same bits, which verify() checks.
+namespace kernels {
+
+// a[i] += b[i], wrapping.
+void add(fix *a, const fix *b, std::size_t n);
+// out[i] = a[i] * k, rounded like fix's operator*. out may be a.
+void scale(fix *out, const fix *a, fix k, std::size_t n);
+// out[i] = (x[i] - px)^2 + (y[i] - py)^2. The sum is rounded once, so it can
+// be one more than with fix's operators. Past the largest fix it saturates
+// rather than wrapping, so far apart is never near.
+void distance_squared(fix *out, const fix *x, const fix *y, fix px, fix py,
+                      std::size_t n);
+// position[i] += velocity[i], saturating.
+void integrate(fix *position, const fix *velocity, std::size_t n);
+
+namespace portable {
+void add(fix *a, const fix *b, std::size_t n);
+void scale(fix *out, const fix *a, fix k, std::size_t n);
+void distance_squared(fix *out, const fix *x, const fix *y, fix px, fix py,
+                      std::size_t n);
+void integrate(fix *position, const fix *velocity, std::size_t n);
+} // namespace portable
+
+// Run the kernels and the portable loops over edge cases and random values,
+// and check they agree bit for bit, and with the same work done with fix's
+// operators.
+bool verify();
+
+} // namespace kernels
+
 } // namespace nds
 
 #endif /* NDSPP_H */
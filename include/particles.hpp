@@ -0,0 +1,74 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include "components.hpp"
+#include "ndspp.hpp"
+#include "tecs-system.hpp"
+#include "util.hpp"
+#include "world.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <nds/arm9/sprite.h>
+
+// Sparks, debris and smoke: short-lived, purely visual, and far too many to be
+// entities. Particles live in a fixed-size pool of parallel arrays, updated by
+// the batch kernels with no lookups, and are drawn in a range of OAM slots
+// reserved from the SpriteIdManager, so they never take a slot from an entity.
+constexpr std::size_t PARTICLE_CAPACITY = 512;
+// Particles past this many are simulated but not drawn.
+constexpr int PARTICLE_SPRITES = 32;
+// Each particle shrinks through these tiles as it dies.
+constexpr int PARTICLE_FRAMES = 4;
+
+struct ParticlePool {
+  // Live particles are [0, count): a dead one is replaced by the last.
+  std::array<nds::fix, PARTICLE_CAPACITY> x;
+  std::array<nds::fix, PARTICLE_CAPACITY> y;
+  std::array<nds::fix, PARTICLE_CAPACITY> vx;
+  std::array<nds::fix, PARTICLE_CAPACITY> vy;
+  // Frames left to live.
+  std::array<uint16_t, PARTICLE_CAPACITY> life;
+  std::array<uint8_t, PARTICLE_CAPACITY> frame;
+  std::size_t count = 0;
+  // Particles not emitted because the pool was full.
+  uint32_t dropped = 0;
+
+  void clear() { count = 0; }
+};
+
+// The particle tiles, and the OAM slots they're drawn in.
+struct ParticleSprites {
+  // Shrinking copies of an 8x8 256-colour sprite's first tile, which share
+  // its palette.
+  ParticleSprites(OamState *oam, const SpriteData &source);
+  ~ParticleSprites();
+
+  // Take this round's slots. Call straight after SpriteIdManager::reset(),
+  // before anything else wants a sprite.
+  void reserve(SpriteIdManager &sprite_id_manager);
+
+  OamState *oam;
+  int palette_index;
+  std::array<uint16_t *, PARTICLE_FRAMES> tiles;
+  std::array<int, PARTICLE_SPRITES> ids;
+  int id_count = 0;
+};
+
+void emit_particle(ParticlePool &pool, const Vec3 &position,
+                   const Vec3 &velocity, uint16_t life);
+// count particles flying out of position in random directions, at up to speed
+// pixels per frame.
+void emit_burst(ParticlePool &pool, const Vec3 &position, int count,
+                nds::fix speed, uint16_t life);
+
+// One simulation step: move, slow down, age and cull every particle.
+void update_particles(ParticlePool &pool);
+// Fill the reserved slots from the pool, hiding those left over.
+void draw_particles(const ParticlePool &pool, const ParticleSprites &sprites,
+                    const Camera &camera);
+
+// Emit from entities with a ParticleTrail.
+Tecs::SingleEntitySetSystem::Function particle_trails;
+
+#endif /* PARTICLES_H */
@@ -0,0 +1,257 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "alloc_tracking.hpp"
+#include "scheduler.hpp"
+#include "stats.hpp"
+#include "tecs-system.hpp"
+#include "tecs.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <ranges>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Systems declared at compile time, rather than as entities found by tag:
+//
+//   using Physics = Pipeline<
+//       Phase<System<"following_ai", following_ai, Signature<Following>,
+//                    Reads<Following, Position>, Writes<Velocity>>>,
+//       Phase<...>>;
+//
+// A pipeline runs its phases in order, and each phase runs its systems with
+// direct calls. Systems in one phase may run in any order, so they must not
+// touch the same component unless they both only read it: that is checked
+// when the phase is declared.
+//
+// With MAGIC_BATTLE_PARALLEL (see scheduler.hpp), a pipeline instead runs each
+// system as soon as every earlier system it conflicts with has finished, and
+// systems that don't conflict run at once. A system's signature counts as
+// reads, since adding or removing those components changes its entities.
+// Systems that take an EntityRange, rather than a set, promise that each
+// entity's work is independent, and are split across threads.
+
+// What range systems are given. With MAGIC_BATTLE_PARALLEL, a span over a copy
+// of the system's entities, so they can be split up; otherwise the set itself.
+#ifdef MAGIC_BATTLE_PARALLEL
+using EntityRange = std::span<const Tecs::Entity>;
+#else
+using EntityRange = std::ranges::subrange<
+    std::unordered_set<Tecs::Entity>::const_iterator>;
+#endif
+
+// Component masks by type, filled in by register_component.
+template <typename T> inline Tecs::ComponentMask component_mask{};
+
+template <typename T>
+Tecs::ComponentMask register_component(Tecs::Coordinator &ecs) {
+  return component_mask<T> = ecs.registerComponent<T>();
+}
+
+// The components an entity needs for a system to run on it.
+template <typename... Ts> struct Signature {
+  static Tecs::ComponentMask mask() {
+    return (Tecs::ComponentMask{} | ... | component_mask<Ts>);
+  }
+};
+// What a system reads and writes: components, or other shared state.
+template <typename... Ts> struct Reads {};
+template <typename... Ts> struct Writes {};
+
+template <std::size_t N> struct SystemName {
+  char value[N];
+  constexpr SystemName(const char (&name)[N]) {
+    std::copy_n(name, N, value);
+  }
+};
+
+template <SystemName Name, auto Function, typename Sig, typename R = Reads<>,
+          typename W = Writes<>>
+struct System {
+  static constexpr const char *name = Name.value;
+  using signature = Sig;
+  using reads = R;
+  using writes = W;
+
+  static void run(Tecs::Coordinator &ecs,
+                  const std::unordered_set<Tecs::Entity> &entities) {
+    stats::record_system(name, entities.size());
+    const alloc::SystemScope allocations{name};
+    if constexpr (std::is_invocable_v<decltype(Function), Tecs::Coordinator &,
+                                      EntityRange>) {
+#ifdef MAGIC_BATTLE_PARALLEL
+      static std::vector<Tecs::Entity> range;
+      range.assign(entities.begin(), entities.end());
+      scheduler::chunks(range.size(), [&](std::size_t begin, std::size_t end) {
+        // Chunks may run on other threads, which have their own scope.
+        const alloc::SystemScope chunk_allocations{name};
+        Function(ecs, EntityRange{range}.subspan(begin, end - begin));
+      });
+#else
+      Function(ecs, EntityRange{entities});
+#endif
+    } else if constexpr (std::is_invocable_v<
+                             decltype(Function), Tecs::Coordinator &,
+                             const std::unordered_set<Tecs::Entity> &>) {
+      Function(ecs, entities);
+    } else {
+      for (const Tecs::Entity entity : entities) {
+        Function(ecs, entity);
+      }
+    }
+  }
+};
+
+/* conflict detection */
+namespace pipeline_detail {
+template <typename T, typename List> constexpr bool contains = false;
+template <typename T, template <typename...> class List, typename... Ts>
+constexpr bool contains<T, List<Ts...>> = (std::is_same_v<T, Ts> or ...);
+
+template <typename A, typename B> constexpr bool overlaps = false;
+template <template <typename...> class List, typename... Ts, typename B>
+constexpr bool overlaps<List<Ts...>, B> = (contains<Ts, B> or ...);
+
+template <typename A, typename B>
+constexpr bool conflicts =
+    overlaps<typename A::writes, typename B::writes> or
+    overlaps<typename A::writes, typename B::reads> or
+    overlaps<typename A::reads, typename B::writes> or
+    overlaps<typename A::writes, typename B::signature> or
+    overlaps<typename A::signature, typename B::writes>;
+
+template <typename... Systems> struct conflict_free : std::true_type {};
+template <typename First, typename... Rest>
+struct conflict_free<First, Rest...>
+    : std::bool_constant<(not conflicts<First, Rest> and ...) and
+                         conflict_free<Rest...>::value> {};
+} // namespace pipeline_detail
+
+template <typename... Systems> struct Phase {
+  static_assert(pipeline_detail::conflict_free<Systems...>::value,
+                "Systems in a phase must not write what another reads or "
+                "writes: move one to its own phase.");
+
+  using systems = std::tuple<Systems...>;
+};
+
+namespace pipeline_detail {
+// The order a pipeline's systems run in, in waves: each system goes in the
+// wave after the last earlier system it conflicts with. Systems in a wave
+// don't conflict, and conflicting systems keep the order they were declared
+// in, so any order within a wave gives the same results as running them one
+// by one.
+template <typename Systems> struct Schedule;
+template <typename... Systems> struct Schedule<std::tuple<Systems...>> {
+  static constexpr std::size_t size = sizeof...(Systems);
+  using Runner = void (*)(Tecs::Coordinator &,
+                          const std::unordered_set<Tecs::Entity> &);
+  static constexpr std::array<Runner, size> runners = {&Systems::run...};
+
+  template <typename A>
+  static constexpr std::array<bool, size> conflicts_with = {
+      conflicts<A, Systems>...};
+  static constexpr std::array<std::array<bool, size>, size> conflict = {
+      conflicts_with<Systems>...};
+
+  static constexpr std::array<std::size_t, size> wave = [] {
+    std::array<std::size_t, size> wave{};
+    for (std::size_t i = 0; i < size; ++i) {
+      for (std::size_t j = 0; j < i; ++j) {
+        if (conflict[j][i]) {
+          wave[i] = std::max(wave[i], wave[j] + 1);
+        }
+      }
+    }
+    return wave;
+  }();
+  static constexpr std::size_t wave_count =
+      size == 0 ? 0 : *std::max_element(wave.begin(), wave.end()) + 1;
+
+  // System indices by wave, and where each wave starts in them.
+  static constexpr std::array<std::size_t, size> order = [] {
+    std::array<std::size_t, size> order{};
+    std::size_t n = 0;
+    for (std::size_t w = 0; w < wave_count; ++w) {
+      for (std::size_t i = 0; i < size; ++i) {
+        if (wave[i] == w) {
+          order[n++] = i;
+        }
+      }
+    }
+    return order;
+  }();
+  static constexpr std::array<std::size_t, wave_count + 1> starts = [] {
+    std::array<std::size_t, wave_count + 1> starts{};
+    for (std::size_t i = 0; i < size; ++i) {
+      starts[wave[i] + 1]++;
+    }
+    for (std::size_t w = 0; w < wave_count; ++w) {
+      starts[w + 1] += starts[w];
+    }
+    return starts;
+  }();
+};
+} // namespace pipeline_detail
+
+template <typename... Phases> class Pipeline {
+public:
+  using systems =
+      decltype(std::tuple_cat(std::declval<typename Phases::systems>()...));
+  static constexpr std::size_t size = std::tuple_size_v<systems>;
+  using schedule = pipeline_detail::Schedule<systems>;
+
+  // Register each system's signature as an interest. Call once per
+  // Coordinator.
+  void declare(Tecs::Coordinator &ecs) {
+    declare(ecs, std::make_index_sequence<size>{});
+  }
+
+  void run(Tecs::Coordinator &ecs) const {
+    const auto &sets = ecs.interests.sets;
+#ifdef MAGIC_BATTLE_PARALLEL
+    for (std::size_t wave = 0; wave < schedule::wave_count; ++wave) {
+      const std::size_t start = schedule::starts[wave];
+      scheduler::parallel(schedule::starts[wave + 1] - start,
+                          [&](std::size_t i) {
+                            const std::size_t system =
+                                schedule::order[start + i];
+                            schedule::runners[system](
+                                ecs, sets[interests[system]]);
+                          });
+    }
+#else
+    run(ecs, sets, std::make_index_sequence<size>{});
+#endif
+  }
+
+private:
+  template <std::size_t... Is>
+  void run(Tecs::Coordinator &ecs,
+           const std::vector<std::unordered_set<Tecs::Entity>> &sets,
+           std::index_sequence<Is...>) const {
+    (std::tuple_element_t<Is, systems>::run(ecs, sets[interests[Is]]), ...);
+  }
+
+  // Tecs keeps an entity set per interest. The sets live in a vector that
+  // registering more interests may grow, so they're looked up by id on each
+  // run rather than held on to.
+  std::array<std::size_t, size> interests{};
+
+  template <std::size_t... Is>
+  void declare(Tecs::Coordinator &ecs, std::index_sequence<Is...>) {
+    ((interests[Is] =
+          ecs.interests
+              .registerInterests(
+                  {{std::tuple_element_t<Is, systems>::signature::mask()}})
+              .front()),
+     ...);
+  }
+};
+
+#endif /* PIPELINE_H */
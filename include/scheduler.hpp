@@ -0,0 +1,69 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+// Fork-join parallelism for the host build. The DS has one core for the game,
+// so unless MAGIC_BATTLE_PARALLEL is defined (-DMAGIC_BATTLE_PARALLEL=ON with
+// CMake, host only) everything here runs in order on the calling thread.
+//
+// Work is handed out as task indices, and the caller returns once every task
+// is done, so callers see the same results as a serial loop as long as the
+// tasks don't touch each other's data. Tasks that start tasks of their own
+// run them serially, rather than wait on the pool from inside it.
+namespace scheduler {
+
+// The fewest entities worth handing to another thread.
+constexpr std::size_t MIN_CHUNK = 256;
+
+#ifdef MAGIC_BATTLE_PARALLEL
+
+using Task = void (*)(void *context, std::size_t index);
+
+// Run task(context, i) for each i in [0, count), on the pool and the calling
+// thread.
+void run(std::size_t count, Task task, void *context);
+
+// Threads besides the caller's. Defaults to one per other hardware thread.
+std::size_t workers();
+// Stop the pool and start count threads, for comparing against serial runs.
+void set_workers(std::size_t count);
+
+#else
+
+inline std::size_t workers() { return 0; }
+
+#endif
+
+// Call f(i) for each i in [0, count).
+template <typename F> void parallel(std::size_t count, F &&f) {
+#ifdef MAGIC_BATTLE_PARALLEL
+  using Function = std::remove_reference_t<F>;
+  run(
+      count,
+      [](void *context, std::size_t index) {
+        (*static_cast<Function *>(context))(index);
+      },
+      const_cast<void *>(static_cast<const void *>(&f)));
+#else
+  for (std::size_t i = 0; i < count; ++i) {
+    f(i);
+  }
+#endif
+}
+
+// Split [0, size) into at most one range per thread, each at least MIN_CHUNK
+// long, and call f(begin, end) on each.
+template <typename F> void chunks(std::size_t size, F &&f) {
+  const std::size_t count =
+      std::clamp<std::size_t>(size / MIN_CHUNK, 1, workers() + 1);
+  parallel(count, [&](std::size_t chunk) {
+    f(size * chunk / count, size * (chunk + 1) / count);
+  });
+}
+
+} // namespace scheduler
+
+#endif /* SCHEDULER_H */
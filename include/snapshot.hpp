@@ -0,0 +1,79 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "components.hpp"
+#include "tecs-system.hpp"
+#include "tecs.hpp"
+#include "util.hpp"
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A world captured as a versioned byte blob:
+//   header     magic, version, entity count, section count
+//   entities   the captured entity IDs
+//   sections   component kind, count, then (entity index, payload) pairs
+//   extra      caller-defined POD, e.g. the round state
+// Callbacks are stored as indices into a table of known functions, sprites as
+// indices into the caller's table of SpriteData.
+struct Snapshot {
+  static constexpr uint32_t MAGIC = 0x5353424d; // "MBSS"
+  static constexpr uint16_t VERSION = 3;
+
+  std::vector<uint8_t> bytes;
+
+  bool empty() const { return bytes.empty(); }
+};
+
+// Snapshot systems run with SnapshotSystemTag, one per captured component.
+// Each is given every entity with its component and records them.
+template <typename T>
+void capture_component(Tecs::Coordinator &ecs,
+                       const std::unordered_set<Tecs::Entity> &entities);
+
+template <typename T>
+void add_snapshot_system(Tecs::Coordinator &ecs, Tecs::ComponentMask mask) {
+  ecs.addComponents(
+      ecs.newEntity(), Tecs::SingleEntitySetSystem{capture_component<T>},
+      SnapshotSystemTag{},
+      Tecs::InterestedClient{ecs.interests.registerInterests({{mask}})});
+}
+
+/* implementation details of capture_snapshot */
+namespace snapshot_detail {
+void begin_capture(std::span<SpriteData *const> sprites);
+std::vector<Tecs::Entity> end_listing();
+Snapshot end_capture(Tecs::Coordinator &ecs, std::span<const uint8_t> extra);
+} // namespace snapshot_detail
+
+// Run the snapshot systems and pack what they saw.
+Snapshot capture_snapshot(Tecs::Coordinator &ecs, auto snapshot_system_interest,
+                          std::span<SpriteData *const> sprites,
+                          std::span<const uint8_t> extra = {}) {
+  snapshot_detail::begin_capture(sprites);
+  runSystems(ecs, snapshot_system_interest);
+  return snapshot_detail::end_capture(ecs, extra);
+}
+
+// The entities a snapshot would capture, found by running the snapshot systems
+// without packing anything.
+std::vector<Tecs::Entity> snapshot_entities(Tecs::Coordinator &ecs,
+                                            auto snapshot_system_interest) {
+  snapshot_detail::begin_capture({});
+  runSystems(ecs, snapshot_system_interest);
+  return snapshot_detail::end_listing();
+}
+
+// Recreate the snapshot's entities. old_to_new maps captured entity IDs to the
+// new ones, and extra receives the caller's data, which must be the size it
+// was captured at. Returns false, changing nothing, unless the blob is a
+// whole, well-formed snapshot of this version.
+bool restore_snapshot(Tecs::Coordinator &ecs, const Snapshot &snapshot,
+                      SpriteIdManager &sprite_id_manager,
+                      std::span<SpriteData *const> sprites,
+                      std::unordered_map<Tecs::Entity, Tecs::Entity> &old_to_new,
+                      std::span<uint8_t> extra = {});
+
+#endif /* SNAPSHOT_H */
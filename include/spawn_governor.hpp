@@ -0,0 +1,85 @@
+#ifndef SPAWN_GOVERNOR_H
+#define SPAWN_GOVERNOR_H
+
+#include "frame_pipeline.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <nds/timers.h>
+
+// Keeps zombie spawning within what the DS can take. The spawner request()s
+// zombies as difficulty dictates, and they're queued. Once per frame, after
+// cleanup has freed sprite slots, release() says how many to spawn in a batch,
+// holding them back while frames run long, sprite slots run short or the
+// world is full. Requests past a short queue are dropped: difficulty is capped
+// for as long as there's no headroom, and carries on scaling once there is.
+class SpawnGovernor {
+public:
+  // cpuGetTiming() ticks in one VBlank.
+  static constexpr uint32_t FRAME_TICKS =
+      static_cast<uint32_t>(uint64_t{BUS_CLOCK} * 10000 / 598261);
+  // Past this average frame cost, nothing spawns.
+  static constexpr uint32_t HIGH_WATER = FRAME_TICKS / 8 * 7;
+  // Past this, one spawn per frame.
+  static constexpr uint32_t LOW_WATER = FRAME_TICKS / 2;
+  // Sprite slots left free for fireballs and explosions.
+  static constexpr std::size_t SPRITE_HEADROOM = 8;
+  // Most entities in the world, awake or asleep.
+  static constexpr std::size_t MAX_POPULATION = 192;
+  // One spawn per simulation step keeps up with any spawn rate.
+  static constexpr int MAX_BATCH = frame::MAX_CATCH_UP;
+  static constexpr int MAX_QUEUED = 2 * MAX_BATCH;
+
+  // Why the last release() held spawns back.
+  enum class Limit : uint8_t {
+    None,
+    FrameTime,
+    Sprites,
+    Population,
+  };
+
+  struct Report {
+    uint32_t requested;
+    uint32_t spawned;
+    // Requests that found the queue full.
+    uint32_t dropped;
+    // Frames where spawns were held back.
+    uint32_t capped_frames;
+  };
+
+  void reset();
+
+  // Ask for a zombie, as difficulty dictates.
+  void request();
+  // The cost of the last frame, from reading input to presenting.
+  void observe(uint32_t frame_ticks);
+  // How many queued zombies to spawn now, given the sprite slots free and the
+  // entities in the world.
+  int release(std::size_t free_sprites, std::size_t population);
+
+  Limit limit() const { return limit_; }
+  // The average frame cost the governor is working from.
+  uint32_t frame_cost() const { return frame_cost_; }
+  const Report &report() const { return report_; }
+
+private:
+  int queued_ = 0;
+  uint32_t frame_cost_ = 0;
+  Limit limit_ = Limit::None;
+  Report report_{};
+};
+
+constexpr const char *spawn_limit_name(SpawnGovernor::Limit limit) {
+  switch (limit) {
+  case SpawnGovernor::Limit::None:
+    return "none";
+  case SpawnGovernor::Limit::FrameTime:
+    return "frame time";
+  case SpawnGovernor::Limit::Sprites:
+    return "sprites";
+  case SpawnGovernor::Limit::Population:
+    return "population";
+  }
+  return "?";
+}
+
+#endif /* SPAWN_GOVERNOR_H */
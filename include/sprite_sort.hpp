@@ -0,0 +1,55 @@
+#ifndef SPRITE_SORT_H
+#define SPRITE_SORT_H
+
+#include "util.hpp"
+#include <array>
+#include <cstdint>
+#include <nds/arm9/sprite.h>
+#include <nds/arm9/video.h>
+
+// Depth order for sprites. OAM entries with lower indices draw on top, so an
+// entity's OAM entry can't just be its sprite slot: that's in allocation
+// order, and crowds overlap at random. Instead, draw_sprites add()s each
+// visible sprite with its screen row, and commit() counting-sorts them by row
+// and hands out OAM entries in that order, lowest on screen (nearest) first.
+// Entries that hold the same sprite at the same place as last frame aren't
+// rewritten.
+//
+// Sorted sprites only use the OAM entries not reserved from the
+// SpriteIdManager, so particles keep theirs, on top of everything.
+class SpriteSorter {
+public:
+  // Take the unreserved OAM entries, and forget what's in them. Call after
+  // reserving, at the start of each round.
+  void reset(const SpriteIdManager &sprite_id_manager);
+
+  // Draw sprite with its top left at (x, y), at depth row: its screen row,
+  // clamped to [0, SCREEN_HEIGHT).
+  void add(const SpriteData &sprite, int x, int y, int row);
+  // Sort the sprites added since the last commit into OAM, and hide the
+  // entries left over.
+  void commit(OamState *oam);
+
+private:
+  struct Entry {
+    // nullptr for a hidden entry.
+    const SpriteData *sprite;
+    int16_t x;
+    int16_t y;
+
+    bool operator==(const Entry &) const = default;
+  };
+  // What an entry holds when the sorter doesn't know.
+  static constexpr Entry UNKNOWN = {nullptr, INT16_MIN, INT16_MIN};
+
+  std::array<Entry, SPRITE_COUNT> added;
+  std::array<uint8_t, SPRITE_COUNT> rows;
+  int added_count = 0;
+  // The unreserved OAM entries, in drawing order.
+  std::array<uint8_t, SPRITE_COUNT> entries;
+  int entry_count = 0;
+  // What commit() last wrote to each OAM entry.
+  std::array<Entry, SPRITE_COUNT> written;
+};
+
+#endif /* SPRITE_SORT_H */
@@ -0,0 +1,134 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+
+// Volume counters for the hot paths, to go with the timings: how many
+// entities each system saw, how many collision pairs were tested, and so on.
+// Counters are kept per frame. end_frame() moves the current frame's into
+// last_frame() and adds them to the totals.
+//
+// Everything here compiles to nothing unless MAGIC_BATTLE_STATS is defined
+// (STATS=1 with make, -DMAGIC_BATTLE_STATS=ON with CMake).
+namespace stats {
+
+enum class Counter : uint8_t {
+  EntitiesCreated,
+  EntitiesDestroyed,
+  // Components added to or removed from entities, each of which moves the
+  // entity between interest sets. Added through add_components.
+  StructuralChanges,
+  // Coordinator::getComponent calls, made through lookup.
+  ComponentLookups,
+  CollisionPairTests,
+  CollisionHits,
+  TimerCallbacks,
+  SoundEffects,
+  // OAM entries draw_sprites changed.
+  OamWrites,
+  // Sprite slots taken from another entity, which then waits for one.
+  SpriteEvictions,
+  // Entities left without a slot because the wait list was full.
+  SpriteWaitsDropped,
+  // Scratch arrays that didn't fit in the DTCM hot arena, so went in main RAM.
+  HotArenaFailures,
+  // Sampled at the end of the frame rather than counted.
+  SpritesInUse,
+  ParticlesLive,
+  // Most bytes of the hot arena in use at once during the frame.
+  HotArenaPeak,
+  COUNT,
+};
+
+constexpr const char *COUNTER_NAMES[] = {
+    "entities_created", "entities_destroyed", "structural_changes",
+    "component_lookups", "collision_pair_tests", "collision_hits",
+    "timer_callbacks", "sound_effects", "oam_writes", "sprite_evictions",
+    "sprite_waits_dropped", "hot_arena_failures", "sprites_in_use",
+    "particles_live", "hot_arena_peak",
+};
+static_assert(std::size(COUNTER_NAMES) ==
+              static_cast<std::size_t>(Counter::COUNT));
+
+// Systems are told apart by their name pointer, from Pipeline's System.
+constexpr std::size_t MAX_SYSTEMS = 16;
+
+struct SystemCount {
+  const char *name;
+  uint32_t entities;
+};
+
+struct Frame {
+  std::array<uint32_t, static_cast<std::size_t>(Counter::COUNT)> counters{};
+  std::array<SystemCount, MAX_SYSTEMS> systems{};
+  std::size_t system_count = 0;
+
+  uint32_t operator[](Counter counter) const {
+    return counters[static_cast<std::size_t>(counter)];
+  }
+};
+
+#ifdef MAGIC_BATTLE_STATS
+
+extern Frame current;
+
+inline void add(Counter counter, uint32_t n) {
+#ifdef MAGIC_BATTLE_PARALLEL
+  // Systems may count from several threads at once.
+  std::atomic_ref(current.counters[static_cast<std::size_t>(counter)])
+      .fetch_add(n, std::memory_order_relaxed);
+#else
+  current.counters[static_cast<std::size_t>(counter)] += n;
+#endif
+}
+inline void set(Counter counter, uint32_t value) {
+  current.counters[static_cast<std::size_t>(counter)] = value;
+}
+
+void record_system(const char *name, std::size_t entities);
+void end_frame();
+// Clear the current frame, the last frame and the totals.
+void reset();
+
+const Frame &last_frame();
+// Every frame since reset(). Sampled counters hold their peak.
+const Frame &totals();
+uint32_t frames();
+
+// The last frame's counters, and then its entities per system, each a page
+// of the console HUD, with room for a few more lines below.
+void print_counters();
+void print_systems();
+// The totals as CSV rows: label,counter,total,per_frame
+void dump(FILE *file, const char *label);
+
+#define STAT_ADD(counter, n) ::stats::add(::stats::Counter::counter, (n))
+#define STAT_SET(counter, value)                                               \
+  ::stats::set(::stats::Counter::counter, (value))
+
+#else
+
+inline void record_system(const char *, std::size_t) {}
+inline void end_frame() {}
+inline void reset() {}
+inline void print_counters() {
+  printf("Built without MAGIC_BATTLE_STATS.\n");
+}
+inline void print_systems() {}
+inline void dump(FILE *, const char *) {}
+
+#define STAT_ADD(counter, n) ((void)0)
+#define STAT_SET(counter, value) ((void)0)
+
+#endif
+
+#define STAT_INC(counter) STAT_ADD(counter, 1)
+
+} // namespace stats
+
+#endif /* STATS_H */
@@ -1,16 +1,90 @@
 #ifndef SYSTEMS_H
 #define SYSTEMS_H
 
+#include "components.hpp"
+#include "particles.hpp"
+#include "pipeline.hpp"
 #include "tecs-system.hpp"
+#include "world.hpp"
+
+// Range systems: each entity's work is independent, so they may be split.
+void apply_velocity(Tecs::Coordinator &ecs, EntityRange entities);
+void following_ai(Tecs::Coordinator &ecs, EntityRange entities);
 
-Tecs::SingleEntitySetSystem::Function apply_velocity;
 Tecs::SingleEntitySetSystem::Function draw_sprites;
-Tecs::SingleEntitySetSystem::Function following_ai;
 Tecs::SingleEntitySetSystem::Function circular_collision_detection;
+Tecs::SingleEntitySetSystem::Function timer_callbacks;
+Tecs::SingleEntitySetSystem::Function health_check;
 
 Tecs::PerEntitySystem::Function sprite_id_reclamation;
 Tecs::PerEntitySystem::Function affine_index_reclamation;
+Tecs::PerEntitySystem::Function destroy_marked;
 
 Tecs::PerEntitySystem::Function affine_rendering;
 
+// Shared state systems touch besides components.
+struct Oam {};
+struct Chunks {};
+struct Particles {};
+// sprite_id_manager's slots, owners and wait list.
+struct SpriteSlots {};
+// Entities queued with Coordinator::queueDestroyEntity.
+struct DestroyQueue {};
+
+using RenderingPipeline =
+    Pipeline<Phase<System<"draw_sprites", draw_sprites,
+                          Signature<Position, SpriteInfo, Awake>,
+                          Reads<Position, SpriteInfo>, Writes<Oam>>
+                   // System<"affine_rendering", affine_rendering,
+                   //        Signature<Affine>, Reads<Affine>, Writes<Oam>>
+                   >>;
+
+using PhysicsPipeline =
+    Pipeline<Phase<System<"following_ai", following_ai,
+                          Signature<Following, Awake>,
+                          Reads<Following, Position>, Writes<Velocity>>>,
+             Phase<System<"apply_velocity", apply_velocity,
+                          Signature<Position, Velocity, Awake>,
+                          Reads<Velocity>, Writes<Position>>>,
+             Phase<System<"particle_trails", particle_trails,
+                          Signature<Position, Velocity, ParticleTrail, Awake>,
+                          Reads<Position, Velocity>,
+                          Writes<ParticleTrail, Particles>>>,
+             // Collision callbacks emit particles.
+             Phase<System<"circular_collision_detection",
+                          circular_collision_detection,
+                          Signature<Position, Collision, Awake>,
+                          Reads<Position, Collision>,
+                          Writes<Health, Particles>>>,
+             // Last, so entities that moved this frame go to sleep before
+             // anything else sees them.
+             Phase<System<"chunk_tracking", chunk_tracking,
+                          Signature<Position, ChunkCell, Awake>,
+                          Reads<Position>,
+                          Writes<ChunkCell, Awake, Chunks>>>>;
+
+using AdminPipeline =
+    Pipeline<Phase<System<"timer_callbacks", timer_callbacks,
+                          Signature<TimerCallback>, Reads<TimerCallback>,
+                          Writes<DeathMark>>>,
+             Phase<System<"health_check", health_check, Signature<Health>,
+                          Reads<Health>, Writes<DeathMark>>>>;
+
+// Death Mark Handling.
+using CleanupPipeline =
+    Pipeline<Phase<System<"sprite_id_reclamation", sprite_id_reclamation,
+                          Signature<DeathMark, SpriteInfo>, Reads<DeathMark>,
+                          // Including the heir given a freed slot.
+                          Writes<SpriteInfo, SpriteSlots>>,
+                   System<"chunk_reclamation", chunk_reclamation,
+                          Signature<DeathMark, ChunkCell>,
+                          Reads<DeathMark, ChunkCell>, Writes<Chunks>>,
+                   // System<"affine_index_reclamation",
+                   //        affine_index_reclamation,
+                   //        Signature<DeathMark, Affine>, Reads<DeathMark,
+                   //        Affine>>,
+                   System<"destroy_marked", destroy_marked,
+                          Signature<DeathMark>, Reads<DeathMark>,
+                          Writes<DestroyQueue>>>>;
+
 #endif /* SYSTEMS_H */
@@ -0,0 +1,92 @@
+#ifndef TCM_H
+#define TCM_H
+
+#include "stats.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+// Placement in the ARM9's tightly coupled memories, which run at full speed
+// without going through the cache: 32 KB of ITCM for code, and 16 KB of DTCM
+// for data, shared with the stack. devkitARM's ds_arm9 linker script already
+// has .itcm and .dtcm sections, and the startup code copies them in.
+//
+//   HOT_CODE void apply_velocity(...);   // in ITCM
+//   HOT_DATA uint8_t buffer[1024];       // in DTCM, zeroed
+//
+// Only definitions need HOT_CODE: ITCM is within branch range of main RAM.
+// Inline functions are compiled into their callers, so nds::fix's operators
+// come along with the functions that use them. On the host, both expand to
+// nothing.
+#ifdef ARM9
+#include <nds/ndstypes.h>
+#define HOT_CODE ITCM_CODE
+#define HOT_DATA DTCM_BSS
+#else
+#define HOT_CODE
+#define HOT_DATA
+#endif
+
+// Size of the hot arena's DTCM buffer. Keep it well clear of 16 KB: the rest
+// of DTCM is the stack.
+constexpr std::size_t HOT_ARENA_SIZE = 6 * 1024;
+
+// A bump allocator over a HOT_DATA buffer, for scratch arrays the hot loops
+// read over and over, such as positions and collision radii gathered for
+// circular_collision_detection. Allocations last until the enclosing Scope
+// ends. When the buffer is full, allocate() returns null and the caller uses
+// normal memory instead, and HotArenaFailures counts it.
+class HotArena {
+public:
+  // Frees everything allocated while it was alive.
+  class Scope {
+  public:
+    explicit Scope(HotArena &arena) : arena{arena}, mark{arena.used_} {}
+    ~Scope() { arena.used_ = mark; }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    HotArena &arena;
+    std::size_t mark;
+  };
+
+  HotArena(uint8_t *buffer, std::size_t capacity)
+      : buffer{buffer}, capacity_{capacity} {}
+
+  // Room for n default-initialised Ts, or null if there isn't enough.
+  template <typename T> T *allocate(std::size_t n) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "Scope frees without destroying anything.");
+    const std::size_t start = (used_ + alignof(T) - 1) & ~(alignof(T) - 1);
+    if (start + n * sizeof(T) > capacity_) {
+      STAT_INC(HotArenaFailures);
+      return nullptr;
+    }
+    used_ = start + n * sizeof(T);
+    if (used_ > peak_) {
+      peak_ = used_;
+    }
+    return new (buffer + start) T[n];
+  }
+
+  std::size_t capacity() const { return capacity_; }
+  std::size_t used() const { return used_; }
+  // Most bytes in use at once since the last call, for HotArenaPeak.
+  std::size_t take_peak() {
+    const std::size_t peak = peak_;
+    peak_ = used_;
+    return peak;
+  }
+
+private:
+  uint8_t *buffer;
+  std::size_t capacity_;
+  std::size_t used_ = 0;
+  std::size_t peak_ = 0;
+};
+
+extern HotArena hot_arena;
+
+#endif /* TCM_H */
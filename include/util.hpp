@@ -1,65 +1,119 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include "bitmap_id_manager.hpp"
 #include "components.hpp"
 #include "ndspp.hpp"
 #include "tecs-system.hpp"
 #include "tecs.hpp"
-#include "unusual_id_manager.hpp"
+#include <array>
 #include <cstdint>
 #include <nds.h>
 #include <nds/arm9/sprite.h>
 #include <nds/arm9/video.h>
 #include <nds/dma.h>
+#include <optional>
 #include <span>
 
 void wait_for_start();
 
 constexpr SpriteSize sprite_size(int width, int height);
 
+constexpr int NO_SPRITE = -1;
+
+// What make_sprite does when every OAM slot is in use.
+enum class SpriteExhaustion : uint8_t {
+  // Give up: the entity runs without a sprite.
+  Fail,
+  // Take the slot of the lowest-priority sprite below this one's priority.
+  EvictLowestPriority,
+  // Take the slot of the sprite farthest from the focus, among those with no
+  // higher priority than this one.
+  EvictFarthest,
+  // There is no renderer besides OAM, so join the wait list and take over the
+  // next slot that is released. Evicted entities join it too.
+  Deferred,
+};
+
+using PaletteIdManager = BitmapIdManager<int, 16>;
+using AffineIdManager = BitmapIdManager<int, MATRIX_COUNT>;
+
+struct SpriteIdManager {
+  // Room for everything that can be alive without a slot: the spawn
+  // governor keeps the population well under this.
+  static constexpr int WAIT_LIST_LENGTH = SPRITE_COUNT;
+  // The priority of reserved slots, which nothing can evict.
+  static constexpr int8_t RESERVED = INT8_MAX;
+
+  BitmapIdManager<int, SPRITE_COUNT> ids;
+  // Who holds each slot, and at what priority.
+  std::array<Tecs::Entity, SPRITE_COUNT> owners{};
+  std::array<int8_t, SPRITE_COUNT> priorities{};
+  // Entities waiting for a slot, oldest first.
+  std::array<Tecs::Entity, WAIT_LIST_LENGTH> waiting{};
+  int waiting_count = 0;
+  // EvictFarthest measures from here; main keeps it on the player.
+  Vec3 focus{};
+
+  constexpr void reset() {
+    ids.reset();
+    waiting_count = 0;
+  }
+
+  // Take a slot for something drawn outside the ECS, until the next reset().
+  std::optional<int> reserve() {
+    const auto id = ids.allocate();
+    if (id) {
+      priorities[*id] = RESERVED;
+    }
+    return id;
+  }
+};
+
 struct SpriteData {
   SpriteSize size;
   int width;
   int height;
   // How many tiles/sprites there are.
   int tiles;
-  unusual::id_manager<int, 16> &palette_index_manager;
+  PaletteIdManager &palette_index_manager;
   int palette_index;
+  // Sprites may evict lower-priority ones when OAM is full.
+  int8_t priority;
+  SpriteExhaustion exhaustion;
   SpriteColorFormat color_format;
   const uint8_t *gfx;
   void *vram_memory;
   OamState *oam;
   SpriteData(OamState *oam, const uint8_t *gfx, int width, int height,
-             int tiles, unusual::id_manager<int, 16> &palette_index_manager,
+             int tiles, PaletteIdManager &palette_index_manager,
              SpriteColorFormat color_format, const uint8_t *palette,
-             int palette_length, _ext_palette palette_memory);
+             int palette_length, _ext_palette palette_memory,
+             int8_t priority = 0,
+             SpriteExhaustion exhaustion = SpriteExhaustion::Fail);
   ~SpriteData();
 
   void set_active_tile(int n);
 };
 
 void make_sprite(Tecs::Coordinator &ecs, Tecs::Entity entity,
-                 unusual::id_manager<int, SPRITE_COUNT> &sprite_id_manager,
-                 SpriteData &sprite_data);
+                 SpriteIdManager &sprite_id_manager, SpriteData &sprite_data);
+// Free the entity's slot, handing it to the oldest waiting entity if any.
+void release_sprite_id(Tecs::Coordinator &ecs, Tecs::Entity entity,
+                       SpriteIdManager &sprite_id_manager);
 
 Tecs::Entity
 make_fireball(Tecs::Coordinator &ecs, Vec3 position, Vec3 target,
-              unusual::id_manager<int, SPRITE_COUNT> &sprite_id_manager,
-              SpriteData &sprite);
+              SpriteIdManager &sprite_id_manager, SpriteData &sprite);
 
 Tecs::Entity
 make_zombie(Tecs::Coordinator &ecs, Vec3 position, Tecs::Entity player,
-            nds::fix speed,
-            unusual::id_manager<int, SPRITE_COUNT> &sprite_id_manager,
+            nds::fix speed, SpriteIdManager &sprite_id_manager,
             SpriteData &sprite);
 
 Tecs::Entity
 make_explosion(Tecs::Coordinator &ecs, Vec3 position,
-               unusual::id_manager<int, SPRITE_COUNT> &sprite_id_manager,
-               SpriteData &sprite);
-
-bool circle_circle(Vec3 a_position, nds::fix a_radius_squared, Vec3 b_position,
-                   nds::fix b_radius_squared);
+               SpriteIdManager &sprite_id_manager, SpriteData &sprite);
 
 void take_damage(Tecs::Coordinator &ecs, Tecs::Entity self, Tecs::Entity other);
 void self_destruct(Tecs::Coordinator &ecs, Tecs::Entity self);
@@ -0,0 +1,68 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "components.hpp"
+#include "ndspp.hpp"
+#include "tecs-system.hpp"
+#include "tecs.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <nds/arm9/video.h>
+#include <vector>
+
+// The world is bigger than the screen, and split into square chunks.
+// Entities in chunks near the player are Awake: the rest sleep, skipping AI,
+// movement, collision and drawing until the player comes back.
+constexpr int CHUNK_SIZE = 128;
+constexpr int CHUNK_COLUMNS = 8;
+constexpr int CHUNK_ROWS = 6;
+constexpr int CHUNK_COUNT = CHUNK_COLUMNS * CHUNK_ROWS;
+constexpr int WORLD_WIDTH = CHUNK_COLUMNS * CHUNK_SIZE;
+constexpr int WORLD_HEIGHT = CHUNK_ROWS * CHUNK_SIZE;
+// Chunks at most this many chunks from the player's (in x and y) are awake.
+// Two covers the screen wherever the player is in their chunk.
+constexpr int AWAKE_RADIUS = 2;
+
+static_assert(2 * AWAKE_RADIUS * CHUNK_SIZE >= SCREEN_WIDTH and
+                  2 * AWAKE_RADIUS * CHUNK_SIZE >= SCREEN_HEIGHT,
+              "Everything on screen must be awake.");
+
+// The world position of the top left of the screen.
+struct Camera {
+  nds::fix x;
+  nds::fix y;
+};
+
+struct WorldChunks {
+  // The entities with a ChunkCell in each chunk.
+  std::array<std::vector<Tecs::Entity>, CHUNK_COUNT> members;
+  // The chunk the awake region is centred on, or NO_CHUNK before the first
+  // update_awake_region.
+  int16_t centre = NO_CHUNK;
+
+  bool awake(int16_t chunk) const;
+  // Entities in every chunk, awake or asleep.
+  std::size_t population() const;
+  void reset();
+};
+
+// The chunk containing position. Positions outside the world belong to the
+// nearest chunk on its edge.
+int16_t chunk_of(const Vec3 &position);
+
+// Centre the camera on focus, without showing past the edge of the world.
+void update_camera(Camera &camera, const Vec3 &focus);
+
+// Move the awake region to be centred on the chunk containing focus, waking
+// and sleeping the chunks that enter and leave it.
+void update_awake_region(Tecs::Coordinator &ecs, WorldChunks &world_chunks,
+                         const Vec3 &focus);
+
+// Put new and moved entities in their chunks, and put those that moved into a
+// sleeping chunk to sleep.
+Tecs::SingleEntitySetSystem::Function chunk_tracking;
+// Take dead entities out of their chunks.
+Tecs::PerEntitySystem::Function chunk_reclamation;
+
+#endif /* WORLD_H */
@@ -0,0 +1,258 @@
+#include "alloc_tracking.hpp"
+
+#ifdef MAGIC_BATTLE_ALLOC_TRACKING
+
+#include <algorithm>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+#ifdef MAGIC_BATTLE_PARALLEL
+#include <mutex>
+#endif
+
+namespace alloc {
+
+// All of this is constant-initialised, so it's ready for allocations made
+// before main().
+static Frame current;
+static Frame last;
+static Frame total;
+static uint32_t frame_count = 0;
+static std::size_t live = 0;
+static bool strict = false;
+
+static const char *current_phase = nullptr;
+static thread_local const char *current_system = nullptr;
+static thread_local int exemptions = 0;
+
+#ifdef MAGIC_BATTLE_PARALLEL
+// Systems may allocate from several threads at once.
+static std::mutex mutex;
+#define ALLOC_LOCK() std::lock_guard lock(mutex)
+#else
+#define ALLOC_LOCK() ((void)0)
+#endif
+
+// The entry for a phase and system in frame, added if it isn't there yet.
+static Site *site_entry(Frame &frame, const char *phase, const char *system) {
+  const auto begin = frame.sites.begin();
+  const auto end = begin + frame.site_count;
+  const auto found = std::find_if(begin, end, [=](const Site &site) {
+    return site.phase == phase and site.system == system;
+  });
+  if (found != end) {
+    return &*found;
+  }
+  if (frame.site_count == MAX_SITES) {
+    return nullptr;
+  }
+  frame.sites[frame.site_count] = {phase, system, 0, 0};
+  return &frame.sites[frame.site_count++];
+}
+
+static const char *or_dash(const char *name) {
+  return name == nullptr ? "-" : name;
+}
+
+static void allocated(std::size_t size) {
+  ALLOC_LOCK();
+  if (strict and exemptions == 0) {
+    // Reporting may allocate too.
+    strict = false;
+    fprintf(stderr,
+            "Allocated %lu bytes after warm-up\nPhase: %s\nSystem: %s\n",
+            static_cast<unsigned long>(size), or_dash(current_phase),
+            or_dash(current_system));
+    std::abort();
+  }
+  current.allocations++;
+  current.bytes += static_cast<uint32_t>(size);
+  live += size;
+  current.peak_bytes =
+      std::max(current.peak_bytes, static_cast<uint32_t>(live));
+  if (Site *site = site_entry(current, current_phase, current_system)) {
+    site->allocations++;
+    site->bytes += static_cast<uint32_t>(size);
+  }
+}
+
+static void freed(std::size_t size) {
+  ALLOC_LOCK();
+  current.frees++;
+  live -= size;
+}
+
+void phase(const char *name) { current_phase = name; }
+
+SystemScope::SystemScope(const char *name) : outer{current_system} {
+  current_system = name;
+}
+SystemScope::~SystemScope() { current_system = outer; }
+
+Exempt::Exempt() { exemptions++; }
+Exempt::~Exempt() { exemptions--; }
+
+void end_frame() {
+  ALLOC_LOCK();
+  total.allocations += current.allocations;
+  total.frees += current.frees;
+  total.bytes += current.bytes;
+  total.peak_bytes = std::max(total.peak_bytes, current.peak_bytes);
+  for (std::size_t i = 0; i < current.site_count; ++i) {
+    const Site &site = current.sites[i];
+    if (Site *sum = site_entry(total, site.phase, site.system)) {
+      sum->allocations += site.allocations;
+      sum->bytes += site.bytes;
+    }
+  }
+  last = current;
+  current = {};
+  current.peak_bytes = static_cast<uint32_t>(live);
+  frame_count++;
+#ifdef MAGIC_BATTLE_ALLOC_STRICT
+  if (frame_count == WARM_UP_FRAMES) {
+    strict = true;
+  }
+#endif
+}
+
+void reset() {
+  ALLOC_LOCK();
+  current = {};
+  last = {};
+  total = {};
+  current.peak_bytes = static_cast<uint32_t>(live);
+  frame_count = 0;
+  strict = false;
+}
+
+void relax() {
+  ALLOC_LOCK();
+  strict = false;
+}
+
+const Frame &last_frame() { return last; }
+const Frame &totals() { return total; }
+uint32_t frames() { return frame_count; }
+std::size_t live_bytes() { return live; }
+
+void print_frame() {
+  printf("Allocations (X to hide)\n\n");
+  printf("%-21s %8lu\n", "allocations",
+         static_cast<unsigned long>(last.allocations));
+  printf("%-21s %8lu\n", "bytes", static_cast<unsigned long>(last.bytes));
+  printf("%-21s %8lu\n", "frees", static_cast<unsigned long>(last.frees));
+  printf("%-21s %8lu\n", "heap_in_use", static_cast<unsigned long>(live));
+  printf("%-21s %8lu\n", "heap_peak",
+         static_cast<unsigned long>(total.peak_bytes));
+#ifdef MAGIC_BATTLE_ALLOC_STRICT
+  printf("%-21s %8s\n", "strict",
+         strict                           ? "on"
+         : frame_count < WARM_UP_FRAMES ? "warm-up"
+                                          : "off");
+#endif
+  printf("\nBy phase and system:\n");
+  for (std::size_t i = 0; i < last.site_count; ++i) {
+    const Site &site = last.sites[i];
+    printf("%-8.8s %-16.16s %5lu\n", or_dash(site.phase),
+           or_dash(site.system), static_cast<unsigned long>(site.allocations));
+  }
+}
+
+void dump(FILE *file, const char *label) {
+  fprintf(file, "%s,all,%lu,%lu\n", label,
+          static_cast<unsigned long>(total.allocations),
+          static_cast<unsigned long>(total.bytes));
+  fprintf(file, "%s,heap_peak,0,%lu\n", label,
+          static_cast<unsigned long>(total.peak_bytes));
+  for (std::size_t i = 0; i < total.site_count; ++i) {
+    const Site &site = total.sites[i];
+    fprintf(file, "%s,%s/%s,%lu,%lu\n", label, or_dash(site.phase),
+            or_dash(site.system), static_cast<unsigned long>(site.allocations),
+            static_cast<unsigned long>(site.bytes));
+  }
+}
+
+} // namespace alloc
+
+/* hooks */
+
+#ifdef ARM9
+
+// Linked with --wrap for each, so every call to them, including operator
+// new's in libstdc++, comes here first.
+extern "C" {
+void *__real_malloc(std::size_t size);
+void __real_free(void *block);
+void *__real_realloc(void *block, std::size_t size);
+void *__real_calloc(std::size_t count, std::size_t size);
+
+void *__wrap_malloc(std::size_t size) {
+  void *block = __real_malloc(size);
+  if (block != nullptr) {
+    alloc::allocated(malloc_usable_size(block));
+  }
+  return block;
+}
+
+void __wrap_free(void *block) {
+  if (block != nullptr) {
+    alloc::freed(malloc_usable_size(block));
+  }
+  __real_free(block);
+}
+
+void *__wrap_realloc(void *block, std::size_t size) {
+  const std::size_t old_size =
+      block == nullptr ? 0 : malloc_usable_size(block);
+  void *moved = __real_realloc(block, size);
+  // On failure the old block is left alone.
+  if (moved == nullptr and size != 0) {
+    return nullptr;
+  }
+  if (block != nullptr) {
+    alloc::freed(old_size);
+  }
+  if (moved != nullptr) {
+    alloc::allocated(malloc_usable_size(moved));
+  }
+  return moved;
+}
+
+void *__wrap_calloc(std::size_t count, std::size_t size) {
+  void *block = __real_calloc(count, size);
+  if (block != nullptr) {
+    alloc::allocated(malloc_usable_size(block));
+  }
+  return block;
+}
+}
+
+#else
+
+// The other forms of new and delete, but for the over-aligned ones, come
+// through these.
+void *operator new(std::size_t size) {
+  void *block = std::malloc(size == 0 ? 1 : size);
+  if (block == nullptr) {
+    throw std::bad_alloc{};
+  }
+  alloc::allocated(malloc_usable_size(block));
+  return block;
+}
+
+void operator delete(void *block) noexcept {
+  if (block != nullptr) {
+    alloc::freed(malloc_usable_size(block));
+    std::free(block);
+  }
+}
+
+void operator delete(void *block, std::size_t) noexcept {
+  operator delete(block);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,216 @@
+#include "frame_pipeline.hpp"
+#include <algorithm>
+#include <array>
+#include <nds.h>
+#include <nds/arm9/background.h>
+#include <nds/arm9/cache.h>
+#include <nds/arm9/sprite.h>
+#include <nds/arm9/video.h>
+#include <nds/dma.h>
+#include <nds/timers.h>
+#ifdef ARM9
+#include <nds/interrupts.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+namespace frame {
+namespace {
+
+struct Upload {
+  void *destination;
+  const void *source;
+  uint32_t size;
+};
+
+// Everything one VBlank commits.
+struct Presentation {
+  SpriteEntry oam[SPRITE_COUNT];
+  std::array<Upload, MAX_UPLOADS> uploads;
+  int upload_count = 0;
+  // -1 if the scroll doesn't change.
+  int scroll_background = -1;
+  int scroll_x = 0;
+  int scroll_y = 0;
+  bool has_input = false;
+  InputStamp input{};
+};
+
+Presentation buffers[2];
+// Written by the simulation.
+Presentation *back = &buffers[0];
+// Handed to the VBlank handler, and cleared once it's committed.
+Presentation *volatile pending = nullptr;
+bool running = false;
+Latency measured_latency{};
+
+void record_latency(const InputStamp &input) {
+  const uint32_t frames = vblanks() - input.vblank;
+  const uint32_t us = static_cast<uint32_t>(
+      uint64_t{cpuGetTiming() - input.tick} * 1000000 / BUS_CLOCK);
+  measured_latency.samples++;
+  measured_latency.last_frames = frames;
+  measured_latency.last_us = us;
+  measured_latency.max_frames = std::max(measured_latency.max_frames, frames);
+  measured_latency.max_us = std::max(measured_latency.max_us, us);
+  measured_latency.total_us += us;
+}
+
+void commit(const Presentation &presentation) {
+  dmaCopy(presentation.oam, OAM, sizeof(presentation.oam));
+  for (int i = 0; i < presentation.upload_count; ++i) {
+    const Upload &upload = presentation.uploads[i];
+    dmaCopy(upload.source, upload.destination, upload.size);
+  }
+  if (presentation.scroll_background >= 0) {
+    bgSetScroll(presentation.scroll_background, presentation.scroll_x,
+                presentation.scroll_y);
+    bgUpdate();
+  }
+  if (presentation.has_input) {
+    record_latency(presentation.input);
+  }
+}
+
+#ifdef ARM9
+volatile uint32_t vblank_count = 0;
+
+void on_vblank() {
+  vblank_count = vblank_count + 1;
+  if (pending != nullptr) {
+    commit(*pending);
+    pending = nullptr;
+  }
+}
+
+void wait_for_vblank() { swiWaitForVBlank(); }
+#else
+// There is no VBlank interrupt on the host: VBlanks are counted off the clock
+// at the DS's refresh rate, and present() commits straight away.
+using Clock = std::chrono::steady_clock;
+constexpr std::chrono::duration<double> VBLANK_PERIOD{1.0 / 59.8261};
+Clock::time_point started = Clock::now();
+
+void wait_for_vblank() {
+  std::this_thread::sleep_until(
+      started + std::chrono::duration_cast<Clock::duration>(
+                    VBLANK_PERIOD * (vblanks() + 1)));
+}
+#endif
+
+} // namespace
+
+void start() {
+  for (Presentation &presentation : buffers) {
+    presentation.upload_count = 0;
+    presentation.scroll_background = -1;
+    presentation.has_input = false;
+  }
+  back = &buffers[0];
+  pending = nullptr;
+#ifdef ARM9
+  vblank_count = 0;
+  irqSet(IRQ_VBLANK, on_vblank);
+  irqEnable(IRQ_VBLANK);
+#else
+  started = Clock::now();
+#endif
+  running = true;
+}
+
+void stop() {
+  while (pending != nullptr) {
+    wait_for_vblank();
+  }
+#ifdef ARM9
+  irqSet(IRQ_VBLANK, nullptr);
+#endif
+  running = false;
+}
+
+uint32_t vblanks() {
+#ifdef ARM9
+  return vblank_count;
+#else
+  return static_cast<uint32_t>((Clock::now() - started) / VBLANK_PERIOD);
+#endif
+}
+
+void upload(void *destination, const void *source, uint32_t size) {
+  if (not running or back->upload_count == MAX_UPLOADS) {
+    dmaCopy(source, destination, size);
+    return;
+  }
+  back->uploads[back->upload_count++] = {destination, source, size};
+}
+
+void scroll(int background, int x, int y) {
+  if (not running) {
+    bgSetScroll(background, x, y);
+    bgUpdate();
+    return;
+  }
+  back->scroll_background = background;
+  back->scroll_x = x;
+  back->scroll_y = y;
+}
+
+void present() {
+  // The other buffer becomes the back buffer, so it must be committed.
+  while (pending != nullptr) {
+    wait_for_vblank();
+  }
+  std::copy_n(oamMain.oamMemory, SPRITE_COUNT, back->oam);
+  // The DMA reads from memory, not the cache.
+  DC_FlushRange(back->oam, sizeof(back->oam));
+#ifdef ARM9
+  if (running) {
+    pending = back;
+  } else {
+    commit(*back);
+  }
+#else
+  commit(*back);
+#endif
+  back = back == &buffers[0] ? &buffers[1] : &buffers[0];
+  back->upload_count = 0;
+  back->scroll_background = -1;
+  back->has_input = false;
+}
+
+InputStamp stamp_input() { return {cpuGetTiming(), vblanks()}; }
+
+void mark_input(InputStamp input) {
+  if (not back->has_input) {
+    back->has_input = true;
+    back->input = input;
+  }
+}
+
+const Latency &latency() { return measured_latency; }
+void reset_latency() { measured_latency = {}; }
+
+int Pacer::wait() {
+  while (pending != nullptr or vblanks() == last_vblank) {
+    wait_for_vblank();
+  }
+  const uint32_t now = vblanks();
+  const uint32_t due = now - last_vblank;
+  last_vblank = now;
+
+  pacing_.frames++;
+  if (due > 1) {
+    pacing_.late++;
+    pacing_.skipped += due - 1;
+  }
+  if (due > MAX_CATCH_UP) {
+    pacing_.dropped_steps += due - MAX_CATCH_UP;
+    return MAX_CATCH_UP;
+  }
+  return static_cast<int>(due);
+}
+
+void Pacer::resync() { last_vblank = vblanks(); }
+
+} // namespace frame
@@ -1,14 +1,22 @@
 #include "Sounds_bin.h"
+#include "alloc_tracking.hpp"
 #include "components.hpp"
+#include "frame_pipeline.hpp"
 #include "nds/arm9/sprite.h"
 #include "nds/arm9/video.h"
 #include "ndspp.hpp"
+#include "particles.hpp"
+#include "snapshot.hpp"
 #include "soundbank.h"
+#include "spawn_governor.hpp"
+#include "sprite_sort.hpp"
+#include "stats.hpp"
 #include "systems.hpp"
+#include "tcm.hpp"
 #include "tecs-system.hpp"
 #include "tecs.hpp"
-#include "unusual_id_manager.hpp"
 #include "util.hpp"
+#include "world.hpp"
 #include <ExplosionSprite_gfx.h>
 #include <ExplosionSprite_pal.h>
 #include <FireballSprite_gfx.h>
@@ -44,9 +52,14 @@
 #include <unordered_map>
 #include <unordered_set>
 
-unusual::id_manager<int, SPRITE_COUNT> sprite_id_manager;
-unusual::id_manager<int, MATRIX_COUNT> affine_index_manager;
-unusual::id_manager<int, 16> palette_index_manager;
+SpriteIdManager sprite_id_manager;
+AffineIdManager affine_index_manager;
+PaletteIdManager palette_index_manager;
+Camera camera;
+WorldChunks world_chunks;
+ParticlePool particle_pool;
+SpawnGovernor spawn_governor;
+SpriteSorter sprite_sorter;
 
 enum class Spell {
   Fireball,
@@ -61,6 +74,17 @@ std::unordered_map<Spell, const char *> spell_strings = {
 };
 
 Spell selected_spell = Spell::Fireball;
+// What the HUD shows. X cycles through the frame stats, entities per system
+// and allocations, and B switches to the latency measurement, which only
+// records taps while it's shown.
+enum class Hud {
+  Status,
+  Stats,
+  Systems,
+  Allocations,
+  Latency,
+};
+Hud hud = Hud::Status;
 
 constexpr nds::fix MAX_MAGIC = nds::fix::from_float(100.0f);
 constexpr nds::fix MAGIC_BUILD_RATE = nds::fix::from_float(0.3f);
@@ -85,6 +109,51 @@ using namespace nds;
 
 using namespace Tecs;
 
+// Round state that lives outside the ECS, kept in snapshots' extra data.
+struct RoundState {
+  Entity player_target;
+  Entity player;
+  nds::fix magic_meter;
+  nds::fix alive_clock;
+  int zombie_rate;
+  int16_t zombie_clock;
+  int16_t zombie_level;
+};
+
+// Just off the edge of the screen, which is always in the awake region.
+static Vec3 random_spawn_position(const Camera &camera) {
+  constexpr nds::fix OFFSCREEN_MARGIN = nds::fix::from_float(5.0f);
+  Vec3 position = {};
+  switch (rand() % 4) {
+  case 0:
+    // on the left
+    position.x = camera.x - OFFSCREEN_MARGIN;
+    position.y = camera.y + nds::fix::from_int(rand() % SCREEN_HEIGHT);
+    break;
+  case 1:
+    // on the right
+    position.x = camera.x + FIX_SCREEN_WIDTH + OFFSCREEN_MARGIN;
+    position.y = camera.y + nds::fix::from_int(rand() % SCREEN_HEIGHT);
+    break;
+  case 2:
+    // on the top
+    position.x = camera.x + nds::fix::from_int(rand() % SCREEN_WIDTH);
+    position.y = camera.y - OFFSCREEN_MARGIN;
+    break;
+  case 3:
+    // on the bottom
+    position.x = camera.x + nds::fix::from_int(rand() % SCREEN_WIDTH);
+    position.y = camera.y + FIX_SCREEN_HEIGHT + OFFSCREEN_MARGIN;
+    break;
+  }
+  return position;
+}
+
+// Every round starts from this, once the first round has built it.
+Snapshot initial_snapshot;
+// Debug save state: L saves, R loads.
+Snapshot save_state;
+
 int main(void) {
   srand(PersonalData->rtcOffset % UINT16_MAX);
   // NDS Setup
@@ -96,6 +165,11 @@ int main(void) {
   vramSetBankA(VRAM_A_MAIN_BG);
   int bg3 = bgInit(3, BgType_Bmp8, BgSize_B8_256x256, 0, 0);
   dmaCopy(StoneBackground_gfx, bgGetGfxPtr(bg3), StoneBackground_gfx_size);
+  // The background wraps as the camera scrolls around the world: repeat the
+  // top of the image below the bottom so the whole 256x256 bitmap tiles.
+  dmaCopy(StoneBackground_gfx, bgGetGfxPtr(bg3) + SCREEN_HEIGHT * 256 / 2,
+          (256 - SCREEN_HEIGHT) * 256);
+  bgWrapOn(bg3);
   // dmaCopy(StoneBackground_map, bgGetMapPtr(bg3), StoneBackground_map_size);
   dmaCopy(StoneBackground_pal, &BG_PALETTE[0], StoneBackground_pal_size);
 
@@ -106,20 +180,25 @@ int main(void) {
   SpriteData zombie_sprite(&oamMain, ZombieSprite_gfx, 16, 16, 4,
                            palette_index_manager, SpriteColorFormat_256Color,
                            ZombieSprite_pal, ZombieSprite_pal_size,
-                           VRAM_F_EXT_SPR_PALETTE);
+                           VRAM_F_EXT_SPR_PALETTE, 0,
+                           SpriteExhaustion::EvictFarthest);
   SpriteData player_sprite(&oamMain, PlayerSprite_gfx, 16, 16, 1,
                            palette_index_manager, SpriteColorFormat_256Color,
                            PlayerSprite_pal, PlayerSprite_pal_size,
-                           VRAM_F_EXT_SPR_PALETTE);
+                           VRAM_F_EXT_SPR_PALETTE, 3,
+                           SpriteExhaustion::EvictLowestPriority);
   SpriteData fireball_sprite(&oamMain, FireballSprite_gfx, 8, 8, 1,
                              palette_index_manager, SpriteColorFormat_256Color,
                              FireballSprite_pal, FireballSprite_pal_size,
-                             VRAM_F_EXT_SPR_PALETTE);
+                             VRAM_F_EXT_SPR_PALETTE, 1,
+                             SpriteExhaustion::EvictFarthest);
   SpriteData explosion_sprite(&oamMain, ExplosionSprite_gfx, 64, 64, 1,
                               palette_index_manager, SpriteColorFormat_256Color,
                               ExplosionSprite_pal, ExplosionSprite_pal_size,
-                              VRAM_F_EXT_SPR_PALETTE);
+                              VRAM_F_EXT_SPR_PALETTE, 2,
+                              SpriteExhaustion::EvictLowestPriority);
   vramSetBankF(VRAM_F_SPRITE_EXT_PALETTE);
+  ParticleSprites particle_sprites(&oamMain, fireball_sprite);
 
   mmInitDefaultMem((mm_addr)Sounds_bin);
   mmLoadEffect(SFX_EXPLOSION);
@@ -128,6 +207,9 @@ int main(void) {
   mmLoadEffect(SFX_FIREBALL);
 
   consoleClear();
+  if (not nds::kernels::verify()) {
+    printf("Batch kernels don't match the\nportable loops!\n\n");
+  }
   printf("Magic Battle NDS\n\nArt: Aidan Hall\nSound: Aidan Hall\nCode: Aidan "
          "Hall\n(C) Aidan Hall 2023.\n\nPress start.\n");
   wait_for_start();
@@ -144,203 +226,149 @@ int main(void) {
     Tecs::Coordinator ecs;
     registerSystemComponents(ecs);
 
-    const ComponentMask POSITION_COMPONENT = ecs.registerComponent<Position>();
-    const ComponentMask VELOCITY_COMPONENT = ecs.registerComponent<Velocity>();
+    const ComponentMask POSITION_COMPONENT = register_component<Position>(ecs);
+    const ComponentMask VELOCITY_COMPONENT = register_component<Velocity>(ecs);
     const ComponentMask SPRITEINFO_COMPONENT =
-        ecs.registerComponent<SpriteInfo>();
-    // const ComponentMask ZOMBIE_COMPONENT =
-    ecs.registerComponent<Zombie>();
-    const ComponentMask PHYSICSSYSTEMTAG_COMPONENT =
-        ecs.registerComponent<PhysicsSystemTag>();
-    const ComponentMask RENDERINGSYSTEMTAG_COMPONENT =
-        ecs.registerComponent<RenderingSystemTag>();
+        register_component<SpriteInfo>(ecs);
+    const ComponentMask ZOMBIE_COMPONENT = register_component<Zombie>(ecs);
     const ComponentMask COLLISION_COMPONENT =
-        ecs.registerComponent<Collision>();
-    const ComponentMask ADMINSYSTEMTAG_COMPONENT =
-        ecs.registerComponent<AdminSystemTag>();
-    const ComponentMask CLEANUPSYSTEMTAG_COMPONENT =
-        ecs.registerComponent<CleanupSystemTag>();
-    // const ComponentMask FINALCLEANUPSYSTEMTAG_COMPONENT =
-    //     ecs.registerComponent<FinalCleanupSystemTag>();
+        register_component<Collision>(ecs);
+    const ComponentMask SNAPSHOTSYSTEMTAG_COMPONENT =
+        register_component<SnapshotSystemTag>(ecs);
     const ComponentMask DEATHMARK_COMPONENT =
-        ecs.registerComponent<DeathMark>();
+        register_component<DeathMark>(ecs);
 
     const ComponentMask FOLLOWING_COMPONENT =
-        ecs.registerComponent<Following>();
-    // const ComponentMask AFFINE_COMPONENT = ecs.registerComponent<Affine>();
+        register_component<Following>(ecs);
+    // const ComponentMask AFFINE_COMPONENT = register_component<Affine>(ecs);
     const ComponentMask TIMERCALLBACK_COMPONENT =
-        ecs.registerComponent<TimerCallback>();
-    const ComponentMask HEALTH_COMPONENT = ecs.registerComponent<Health>();
-
-    const auto rendering_system_interest =
-        makeSystemInterest(ecs, RENDERINGSYSTEMTAG_COMPONENT);
-    const auto physics_system_interest =
-        makeSystemInterest(ecs, PHYSICSSYSTEMTAG_COMPONENT);
-    const auto admin_system_interest =
-        makeSystemInterest(ecs, ADMINSYSTEMTAG_COMPONENT);
-    const auto cleanup_system_interest =
-        makeSystemInterest(ecs, CLEANUPSYSTEMTAG_COMPONENT);
-    // const auto finalcleanup_system_interest =
-    //     makeSystemInterest(ecs, FINALCLEANUPSYSTEMTAG_COMPONENT);
-
-    ecs.addComponents(ecs.newEntity(), SingleEntitySetSystem{draw_sprites},
-                      RenderingSystemTag{},
-                      InterestedClient{ecs.interests.registerInterests(
-                          {{POSITION_COMPONENT | SPRITEINFO_COMPONENT}})});
-
-    // ecs.addComponents(
-    //     ecs.newEntity(), PerEntitySystem{affine_rendering},
-    //     RenderingSystemTag{},
-    //     InterestedClient{ecs.interests.registerInterests({{AFFINE_COMPONENT}})});
-
-    ecs.addComponents(ecs.newEntity(), SingleEntitySetSystem{apply_velocity},
-                      PhysicsSystemTag{},
-                      InterestedClient{ecs.interests.registerInterests(
-                          {{POSITION_COMPONENT | VELOCITY_COMPONENT}})});
-
-    ecs.addComponents(ecs.newEntity(), SingleEntitySetSystem{following_ai},
-                      PhysicsSystemTag{},
-                      InterestedClient{ecs.interests.registerInterests(
-                          {{FOLLOWING_COMPONENT}})});
-
-    ecs.addComponents(ecs.newEntity(),
-                      SingleEntitySetSystem{circular_collision_detection},
-                      PhysicsSystemTag{},
-                      InterestedClient{ecs.interests.registerInterests(
-                          {{POSITION_COMPONENT | COLLISION_COMPONENT}})});
-
-    ecs.addComponents(
-        ecs.newEntity(),
-        SingleEntitySetSystem{
-            [](Coordinator &ecs, const std::unordered_set<Entity> &entities) {
-              const uint32_t now = cpuGetTiming();
-              for (const auto entity : entities) {
-
-                const auto tc = ecs.getComponent<TimerCallback>(entity);
-                if (tc.time <= now) {
-                  tc.callback(ecs, entity);
-                }
-              }
-            }},
-        AdminSystemTag{},
-        InterestedClient{
-            ecs.interests.registerInterests({{TIMERCALLBACK_COMPONENT}})});
-
-    ecs.addComponents(
-        ecs.newEntity(),
-        SingleEntitySetSystem{
-            [](Coordinator &ecs, const std::unordered_set<Entity> &entities) {
-              for (const auto entity : entities) {
-
-                const auto health = ecs.getComponent<Health>(entity);
-                if (health.value <= 0) {
-                  // TODO: Resolve this in 1 frame
-                  ecs.addComponent<DeathMark>(entity);
-                  // ecs.queueDestroyEntity(entity);
-                }
-              }
-            }},
-        AdminSystemTag{},
-        InterestedClient{
-            ecs.interests.registerInterests({{HEALTH_COMPONENT}})});
-
-    // ecs.addComponents(
-    //     ecs.newEntity(),
-    //     PerEntitySystem{[](Coordinator &ecs, const Entity entity) {
-    //       Collision &collision = ecs.getComponent<Collision>(entity);
-    //       const nds::fix &width2 =
-    //       ecs.getComponent<SpriteInfo>(entity).width2; const Affine &affine =
-    //       ecs.getComponent<Affine>(entity); const nds::fix scaled_radius =
-    //       nds::fix{affine.scale << 4} * width2; printf("scaled radius: %f\n",
-    //       static_cast<float>(scaled_radius)); collision.radius_squared =
-    //       scaled_radius * scaled_radius;
-    //     }},
-    //     PhysicsSystemTag{},
-    //     InterestedClient{ecs.interests.registerInterests(
-    //         {{COLLISION_COMPONENT | AFFINE_COMPONENT |
-    //         SPRITEINFO_COMPONENT}})});
-
-    // ecs.addComponents(ecs.newEntity(),
-    //                   PerEntitySystem{[](Coordinator &ecs, const Entity
-    //                   entity)
-    //                   {
-    //                     Affine &affine = ecs.getComponent<Affine>(entity);
-    //                     const int32_t rate =
-    //                         ecs.getComponent<GrowthRate>(entity).rate;
-    //                     affine.scale += rate;
-    //                     if (affine.scale > 1 << 10) {
-    //                       ecs.addComponent<DeathMark>(entity);
-    //                     }
-    //                   }},
-    //                   PhysicsSystemTag{},
-    //                   InterestedClient{ecs.interests.registerInterests(
-    //                       {{AFFINE_COMPONENT | GROWTHRATE_COMPONENT}})});
-
-    // Death Mark Handling.
-    ecs.addComponents(ecs.newEntity(), PerEntitySystem{sprite_id_reclamation},
-                      CleanupSystemTag{},
-                      InterestedClient{ecs.interests.registerInterests(
-                          {{DEATHMARK_COMPONENT | SPRITEINFO_COMPONENT}})});
-    // ecs.addComponents(ecs.newEntity(),
-    // PerEntitySystem{affine_index_reclamation},
-    //                   AdminSystemTag{},
-    //                   InterestedClient{ecs.interests.registerInterests(
-    //                       {{DEATHMARK_COMPONENT | AFFINE_COMPONENT}})});
-
-    ecs.addComponents(
-        ecs.newEntity(),
-        PerEntitySystem{[](Coordinator &ecs, const Entity entity) {
-          ecs.queueDestroyEntity(entity);
-        }},
-        CleanupSystemTag{},
-        InterestedClient{
-            ecs.interests.registerInterests({{DEATHMARK_COMPONENT}})});
-
-    // // Final cleanup system
-    // ecs.addComponents(
-    //     ecs.newEntity(),
-    //     PerEntitySystem{[](Coordinator &ecs, const Entity entity) {
-    //       printf("Cleaning up entity: %d\n", entity);
-    //       ecs.addComponent<DeathMark>(entity);
-    //     }},
-    //     FinalCleanupSystemTag{},
-    //     InterestedClient{ecs.interests.registerInterests({{~0}})});
-
-    // Player target setup
-    constexpr Vec3 player_start_pos = Vec3{fix::from_int(SCREEN_WIDTH / 2),
-                                       fix::from_int(SCREEN_HEIGHT / 2), 0};
-    Entity player_target = ecs.newEntity();
-    ecs.addComponents(player_target, Position{player_start_pos});
-
-    // Player setup
-    Entity player = ecs.newEntity();
-    printf("Player is entity %d\n", player);
-    ecs.addComponents(player, Position{player_start_pos}, Velocity{},
-                      Following{player_target, nds::fix::from_float(5.0f)},
-                      Health{10},
-                      Collision{ZOMBIE_LAYER, PLAYER_LAYER,
-                                radius_squared_from_diameter(
-                                    nds::fix::from_int(player_sprite.width)),
-                                take_damage});
-
-    make_sprite(ecs, player, sprite_id_manager, player_sprite);
-
-    // Zombie setup
-
-    int zombie_rate = INITIAL_ZOMBIE_RATE;
-    int16_t zombie_clock = 0;
-    int16_t zombie_level = 1;
-    nds::fix alive_clock = {0};
+        register_component<TimerCallback>(ecs);
+    const ComponentMask HEALTH_COMPONENT = register_component<Health>(ecs);
+    const ComponentMask CHUNKCELL_COMPONENT =
+        register_component<ChunkCell>(ecs);
+    register_component<Awake>(ecs);
+    const ComponentMask PARTICLETRAIL_COMPONENT =
+        register_component<ParticleTrail>(ecs);
+
+    const auto snapshot_system_interest =
+        makeSystemInterest(ecs, SNAPSHOTSYSTEMTAG_COMPONENT);
+
+    RenderingPipeline rendering;
+    PhysicsPipeline physics;
+    AdminPipeline admin;
+    CleanupPipeline cleanup;
+    rendering.declare(ecs);
+    physics.declare(ecs);
+    admin.declare(ecs);
+    cleanup.declare(ecs);
+
+    // Snapshots
+    add_snapshot_system<Position>(ecs, POSITION_COMPONENT);
+    add_snapshot_system<Velocity>(ecs, VELOCITY_COMPONENT);
+    add_snapshot_system<Health>(ecs, HEALTH_COMPONENT);
+    add_snapshot_system<Following>(ecs, FOLLOWING_COMPONENT);
+    add_snapshot_system<Collision>(ecs, COLLISION_COMPONENT);
+    add_snapshot_system<TimerCallback>(ecs, TIMERCALLBACK_COMPONENT);
+    add_snapshot_system<Zombie>(ecs, ZOMBIE_COMPONENT);
+    add_snapshot_system<DeathMark>(ecs, DEATHMARK_COMPONENT);
+    add_snapshot_system<SpriteInfo>(ecs, SPRITEINFO_COMPONENT);
+    add_snapshot_system<ChunkCell>(ecs, CHUNKCELL_COMPONENT);
+    add_snapshot_system<ParticleTrail>(ecs, PARTICLETRAIL_COMPONENT);
+
+    // The table snapshots refer to sprites by.
+    SpriteData *const sprites[] = {&zombie_sprite, &player_sprite,
+                                   &fireball_sprite, &explosion_sprite};
+
+    Entity player_target;
+    Entity player;
+    int zombie_rate;
+    int16_t zombie_clock;
+    int16_t zombie_level;
+    nds::fix alive_clock;
+
+    const auto capture_round = [&]() {
+      const RoundState round{player_target, player,      magic_meter,
+                             alive_clock,   zombie_rate, zombie_clock,
+                             zombie_level};
+      return capture_snapshot(
+          ecs, snapshot_system_interest, sprites,
+          {reinterpret_cast<const uint8_t *>(&round), sizeof(round)});
+    };
+    const auto restore_round = [&](const Snapshot &snapshot) {
+      RoundState round;
+      std::unordered_map<Entity, Entity> old_to_new;
+      const bool restored = restore_snapshot(
+          ecs, snapshot, sprite_id_manager, sprites, old_to_new,
+          {reinterpret_cast<uint8_t *>(&round), sizeof(round)});
+      assert(restored);
+      std::ignore = restored;
+      player_target = old_to_new.at(round.player_target);
+      player = old_to_new.at(round.player);
+      magic_meter = round.magic_meter;
+      alive_clock = round.alive_clock;
+      zombie_rate = round.zombie_rate;
+      zombie_clock = round.zombie_clock;
+      zombie_level = round.zombie_level;
+    };
+
+    // Before any entity gets a sprite.
+    particle_sprites.reserve(sprite_id_manager);
+    sprite_sorter.reset(sprite_id_manager);
+
+    if (initial_snapshot.empty()) {
+      // Player target setup
+      constexpr Vec3 player_start_pos = Vec3{fix::from_int(WORLD_WIDTH / 2),
+                                         fix::from_int(WORLD_HEIGHT / 2), 0};
+      player_target = ecs.newEntity();
+      add_components(ecs, player_target, Position{player_start_pos});
+
+      // Player setup
+      player = ecs.newEntity();
+      printf("Player is entity %d\n", player);
+      add_components(ecs, player, Position{player_start_pos}, Velocity{},
+                     Following{player_target, nds::fix::from_float(5.0f)},
+                     Health{10},
+                     Collision{ZOMBIE_LAYER, PLAYER_LAYER,
+                               radius_squared_from_diameter(
+                                   nds::fix::from_int(player_sprite.width)),
+                               take_damage},
+                     ChunkCell{NO_CHUNK}, Awake{});
+      STAT_ADD(EntitiesCreated, 2);
+
+      make_sprite(ecs, player, sprite_id_manager, player_sprite);
+
+      // Zombie setup
+
+      zombie_rate = INITIAL_ZOMBIE_RATE;
+      zombie_clock = 0;
+      zombie_level = 1;
+      alive_clock = {0};
+      magic_meter = MAX_MAGIC;
+
+      initial_snapshot = capture_round();
+    } else {
+      restore_round(initial_snapshot);
+    }
+    update_camera(camera, lookup<Position>(ecs, player).pos);
+    stats::reset();
+    alloc::reset();
+    spawn_governor.reset();
     cpuStartTiming(0);
+    frame::Pacer pacer;
+    frame::start();
+    pacer.resync();
     while (1) {
-      alive_clock += FRAME_DURATION;
-      runSystems(ecs, rendering_system_interest);
-      // printf("Player health: %d\n", ecs.getComponent<Health>(player).value);
-
-      swiWaitForVBlank();
-      consoleClear();
-      oamUpdate(&oamMain);
+      // Game time to simulate before the next frame is shown: more than one
+      // step if the last frame missed its VBlank.
+      const int steps = pacer.wait();
+      alloc::phase("input");
+      // Input is read as late as it can be while still being simulated this
+      // frame, so its result is committed at the next VBlank.
       scanKeys();
+      const frame::InputStamp input = frame::stamp_input();
+      // Where this frame's cost is measured from, for the spawn governor.
+      uint32_t frame_start = input.tick;
+      consoleClear();
       int held = keysCurrent();
 
       if (held & KEY_SELECT)
@@ -356,9 +384,37 @@ int main(void) {
       if (pressed & KEY_START) {
         printf("Paused. Press start to resume.\n");
         wait_for_start();
+        pacer.resync();
+        frame_start = cpuGetTiming();
       }
 
-      runSystems(ecs, physics_system_interest);
+      if (pressed & KEY_X) {
+        hud = hud == Hud::Stats         ? Hud::Systems
+              : hud == Hud::Systems     ? Hud::Allocations
+              : hud == Hud::Allocations ? Hud::Status
+                                        : Hud::Stats;
+      } else if (pressed & KEY_B) {
+        hud = hud == Hud::Latency ? Hud::Status : Hud::Latency;
+        frame::reset_latency();
+      }
+
+      if (pressed & KEY_L) {
+        const alloc::Exempt exempt;
+        save_state = capture_round();
+      } else if (pressed & KEY_R and not save_state.empty()) {
+        const alloc::Exempt exempt;
+        // Clear out the world, then restore the save state over it.
+        for (const Entity entity :
+             snapshot_entities(ecs, snapshot_system_interest)) {
+          add_components(ecs, entity, DeathMark{});
+        }
+        cleanup.run(ecs);
+        ecs.destroyQueued();
+        world_chunks.reset();
+        particle_pool.clear();
+        spawn_governor.reset();
+        restore_round(save_state);
+      }
 
       if (held & (KEY_LEFT | KEY_Y)) {
         selected_spell = Spell::Teleport;
@@ -372,99 +428,156 @@ int main(void) {
       touchPosition touch_position;
       if (down & KEY_TOUCH) {
         touchRead(&touch_position);
-        Vec3 &position = ecs.getComponent<Position>(player_target).pos;
+        if (hud == Hud::Latency) {
+          frame::mark_input(input);
+        }
+        Vec3 &position = lookup<Position>(ecs, player_target).pos;
         Vec3 target_position;
-        target_position.x = fix::from_int(touch_position.px);
-        target_position.y = fix::from_int(touch_position.py);
+        target_position.x = fix::from_int(touch_position.px) + camera.x;
+        target_position.y = fix::from_int(touch_position.py) + camera.y;
         if (selected_spell == Spell::Teleport and
             magic_meter > TELEPORT_MAGIC) {
           // teleport
           position = target_position;
           magic_meter -= TELEPORT_MAGIC;
           mmEffect(SFX_TELEPORT);
+          STAT_INC(SoundEffects);
         } else if (selected_spell == Spell::Fireball and
                    magic_meter > FIREBALL_MAGIC) {
 
           make_fireball(ecs, position, target_position, sprite_id_manager,
                         fireball_sprite);
           mmEffect(SFX_FIREBALL);
+          STAT_INC(SoundEffects);
           magic_meter -= FIREBALL_MAGIC;
         } else if (selected_spell == Spell::Explosion and
                    magic_meter > EXPLOSION_MAGIC) {
           make_explosion(ecs, position, sprite_id_manager, explosion_sprite);
           mmEffect(SFX_EXPLOSION);
+          STAT_INC(SoundEffects);
           magic_meter -= EXPLOSION_MAGIC;
         }
       }
 
-      if (magic_meter < MAX_MAGIC) {
-        magic_meter += MAGIC_BUILD_RATE;
-      } else {
-        magic_meter = MAX_MAGIC;
+      alloc::phase("simulate");
+      for (int step = 0; step < steps; ++step) {
+        alive_clock += FRAME_DURATION;
+        physics.run(ecs);
+        update_particles(particle_pool);
+        const Vec3 &player_position = lookup<Position>(ecs, player).pos;
+        update_awake_region(ecs, world_chunks, player_position);
+        update_camera(camera, player_position);
+
+        if (magic_meter < MAX_MAGIC) {
+          magic_meter += MAGIC_BUILD_RATE;
+        } else {
+          magic_meter = MAX_MAGIC;
+        }
+
+        // Increase zombie rate
+        zombie_clock += 1;
+        if (zombie_clock > ZOMBIE_INCREASE_PERIOD) {
+          zombie_rate += ZOMBIE_INCREASE;
+          zombie_level += 1;
+          zombie_clock = 0;
+        }
+
+        // Randomly ask for a zombie. The governor decides when it spawns.
+        if (rand() < zombie_rate) {
+          spawn_governor.request();
+        }
+
+        admin.run(ecs);
+        cleanup.run(ecs);
+        ecs.destroyQueued();
       }
 
-      int8_t player_health = ecs.getComponent<Health>(player).value;
+      // Spawn in one batch, now cleanup has freed this frame's sprite slots.
+      alloc::phase("spawn");
+      for (int n = spawn_governor.release(sprite_id_manager.ids.available(),
+                                          world_chunks.population());
+           n > 0; --n) {
+        make_zombie(ecs, random_spawn_position(camera), player, ZOMBIE_SPEED,
+                    sprite_id_manager, zombie_sprite);
+      }
+
+      int8_t player_health = lookup<Health>(ecs, player).value;
       if (player_health <= 0) {
         break;
       }
-      printf("Time Alive: %f\n\nHealth: %d\nMagic: %f\n\nFireball: "
-             "%ld\nTeleport (Left/Y): %ld\nExplosion (Right/A): "
-             "%ld\nSelected spell: %s\n\nZombie Level: %d",
-             static_cast<float>(alive_clock), player_health,
-             static_cast<float>(magic_meter),
-             static_cast<int32_t>(FIREBALL_MAGIC),
-             static_cast<int32_t>(TELEPORT_MAGIC),
-             static_cast<int32_t>(EXPLOSION_MAGIC),
-             spell_strings.at(selected_spell), zombie_level);
-
-      // Increase zombie rate
-      zombie_clock += 1;
-      if (zombie_clock > ZOMBIE_INCREASE_PERIOD) {
-        zombie_rate += ZOMBIE_INCREASE;
-        zombie_level += 1;
-        zombie_clock = 0;
-      }
-
-      // Randomly spawn a zombie
-
-      if (rand() < zombie_rate) {
-        constexpr nds::fix OFFSCREEN_MARGIN = nds::fix::from_float(5.0f);
-        Vec3 zombie_position = {};
-        switch (rand() % 4) {
-        case 0:
-          // on the left
-          zombie_position.x = nds::fix{0} - OFFSCREEN_MARGIN;
-          zombie_position.y = nds::fix::from_int(rand() % SCREEN_HEIGHT);
-          break;
-        case 1:
-          // on the right
-          zombie_position.x = FIX_SCREEN_WIDTH + OFFSCREEN_MARGIN;
-          zombie_position.y = nds::fix::from_int(rand() % SCREEN_HEIGHT);
-          break;
-        case 2:
-          // on the top
-          zombie_position.x = nds::fix::from_int(rand() % SCREEN_WIDTH);
-          zombie_position.y = nds::fix{0} - OFFSCREEN_MARGIN;
-          break;
-        case 3:
-          // on the bottom
-          zombie_position.x = nds::fix::from_int(rand() % SCREEN_WIDTH);
-          zombie_position.y = FIX_SCREEN_HEIGHT + OFFSCREEN_MARGIN;
-          break;
+      alloc::phase("hud");
+      if (hud == Hud::Stats) {
+        stats::print_counters();
+        const frame::Pacing &pacing = pacer.pacing();
+        printf("\nLate: %lu Skipped: %lu Dropped: %lu\n",
+               static_cast<unsigned long>(pacing.late),
+               static_cast<unsigned long>(pacing.skipped),
+               static_cast<unsigned long>(pacing.dropped_steps));
+        const SpawnGovernor::Report &spawns = spawn_governor.report();
+        const uint64_t frame_cost = spawn_governor.frame_cost();
+        printf("Spawned: %lu/%lu Capped: %lu\nFrame cost: %lu%%\n",
+               static_cast<unsigned long>(spawns.spawned),
+               static_cast<unsigned long>(spawns.requested),
+               static_cast<unsigned long>(spawns.capped_frames),
+               static_cast<unsigned long>(frame_cost * 100 /
+                                          SpawnGovernor::FRAME_TICKS));
+      } else if (hud == Hud::Systems) {
+        stats::print_systems();
+      } else if (hud == Hud::Allocations) {
+        alloc::print_frame();
+      } else if (hud == Hud::Latency) {
+        const frame::Latency &latency = frame::latency();
+        printf("Tap-to-display latency (B to hide)\n\n"
+               "Taps: %lu\n\nLast: %lu frames, %lu us\n"
+               "Max:  %lu frames, %lu us\nMean: %lu us\n",
+               static_cast<unsigned long>(latency.samples),
+               static_cast<unsigned long>(latency.last_frames),
+               static_cast<unsigned long>(latency.last_us),
+               static_cast<unsigned long>(latency.max_frames),
+               static_cast<unsigned long>(latency.max_us),
+               static_cast<unsigned long>(
+                   latency.samples == 0 ? 0
+                                        : latency.total_us / latency.samples));
+      } else {
+        printf("Time Alive: %f\n\nHealth: %d\nMagic: %f\n\nFireball: "
+               "%ld\nTeleport (Left/Y): %ld\nExplosion (Right/A): "
+               "%ld\nSelected spell: %s\n\nZombie Level: %d",
+               static_cast<float>(alive_clock), player_health,
+               static_cast<float>(magic_meter),
+               static_cast<int32_t>(FIREBALL_MAGIC),
+               static_cast<int32_t>(TELEPORT_MAGIC),
+               static_cast<int32_t>(EXPLOSION_MAGIC),
+               spell_strings.at(selected_spell), zombie_level);
+        if (spawn_governor.limit() != SpawnGovernor::Limit::None) {
+          printf(" (capped: %s)",
+                 spawn_limit_name(spawn_governor.limit()));
         }
-        make_zombie(ecs, zombie_position, player, ZOMBIE_SPEED,
-                    sprite_id_manager, zombie_sprite);
       }
 
-      runSystems(ecs, admin_system_interest);
-      runSystems(ecs, cleanup_system_interest);
-      ecs.destroyQueued();
+      alloc::phase("render");
+      sprite_id_manager.focus = lookup<Position>(ecs, player).pos;
+      rendering.run(ecs);
+      draw_particles(particle_pool, particle_sprites, camera);
+      frame::scroll(bg3, static_cast<int32_t>(camera.x),
+                    static_cast<int32_t>(camera.y));
+      frame::present();
+      STAT_SET(SpritesInUse, sprite_id_manager.ids.in_use());
+      STAT_SET(HotArenaPeak, hot_arena.take_peak());
+      stats::end_frame();
+      alloc::end_frame();
+      spawn_governor.observe(cpuGetTiming() - frame_start);
     }
+    frame::stop();
+    // Game over, or quit: both allocate.
+    alloc::relax();
 
     consoleClear();
     oamClear(&oamMain, 0, SPRITE_COUNT - 1);
-    sprite_id_manager = {};
-    affine_index_manager = {};
+    frame::present();
+    sprite_id_manager.reset();
+    affine_index_manager.reset();
+    world_chunks.reset();
+    particle_pool.clear();
     printf("Game Over!\nYou survived for:\n%f seconds.\n\n",
            static_cast<float>(alive_clock));
   }
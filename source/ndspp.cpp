@@ -1,6 +1,280 @@
 #include "ndspp.hpp"
+#include <array>
+#include <cstdint>
+#include <type_traits>
 
 namespace nds {
 /* fix */
 
+static_assert(sizeof(fix) == sizeof(int32_t) and
+                  std::is_standard_layout_v<fix>,
+              "Kernels treat arrays of fix as arrays of int32_t.");
+
+/* batch kernels */
+
+#ifdef ARM9
+// source/ndspp_kernels.s
+extern "C" {
+void nds_kernel_add(int32_t *a, const int32_t *b, std::size_t n);
+void nds_kernel_scale(int32_t *out, const int32_t *a, int32_t k,
+                      std::size_t n);
+void nds_kernel_distance_squared(int32_t *out, const int32_t *x,
+                                 const int32_t *y, int32_t px, int32_t py,
+                                 std::size_t n);
+void nds_kernel_integrate(int32_t *position, const int32_t *velocity,
+                          std::size_t n);
+}
+#endif
+
+namespace kernels {
+
+static int32_t *bits(fix *f) { return reinterpret_cast<int32_t *>(f); }
+static const int32_t *bits(const fix *f) {
+  return reinterpret_cast<const int32_t *>(f);
+}
+
+namespace portable {
+
+// The loops work on int32_t, with unsigned arithmetic where it may wrap. add
+// and integrate are branch-free so they vectorise. scale and distance_squared
+// need signed 64-bit products and shifts to round like the ARM kernels, which
+// the host's baseline vector instructions don't have.
+
+void add(fix *a, const fix *b, std::size_t n) {
+  int32_t *out = bits(a);
+  const int32_t *in = bits(b);
+  for (std::size_t i = 0; i < n; ++i) {
+    out[i] = static_cast<int32_t>(static_cast<uint32_t>(out[i]) +
+                                  static_cast<uint32_t>(in[i]));
+  }
+}
+
+void scale(fix *out, const fix *a, fix k, std::size_t n) {
+  int32_t *result = bits(out);
+  const int32_t *in = bits(a);
+  for (std::size_t i = 0; i < n; ++i) {
+    result[i] = static_cast<int32_t>((int64_t{in[i]} * k.bits) >> 12);
+  }
+}
+
+void distance_squared(fix *out, const fix *x, const fix *y, fix px, fix py,
+                      std::size_t n) {
+  int32_t *result = bits(out);
+  const int32_t *xs = bits(x);
+  const int32_t *ys = bits(y);
+  for (std::size_t i = 0; i < n; ++i) {
+    const int64_t dx = static_cast<int32_t>(static_cast<uint32_t>(xs[i]) -
+                                            static_cast<uint32_t>(px.bits));
+    const int64_t dy = static_cast<int32_t>(static_cast<uint32_t>(ys[i]) -
+                                            static_cast<uint32_t>(py.bits));
+    // Each square is at most 2^62, so their sum fits unsigned.
+    const uint64_t sum =
+        (static_cast<uint64_t>(dx * dx) + static_cast<uint64_t>(dy * dy)) >>
+        12;
+    result[i] = sum > INT32_MAX ? INT32_MAX : static_cast<int32_t>(sum);
+  }
+}
+
+void integrate(fix *position, const fix *velocity, std::size_t n) {
+  int32_t *out = bits(position);
+  const int32_t *in = bits(velocity);
+  for (std::size_t i = 0; i < n; ++i) {
+    const int32_t a = out[i];
+    const int32_t b = in[i];
+    const int32_t sum = static_cast<int32_t>(static_cast<uint32_t>(a) +
+                                             static_cast<uint32_t>(b));
+    // Overflow if both had the other sign to the sum. It saturates towards
+    // a's sign: INT32_MAX for positive, INT32_MIN for negative.
+    const bool overflow = ((a ^ sum) & (b ^ sum)) < 0;
+    out[i] = overflow ? (a >> 31) ^ INT32_MAX : sum;
+  }
+}
+
+} // namespace portable
+
+#ifdef ARM9
+
+void add(fix *a, const fix *b, std::size_t n) {
+  nds_kernel_add(bits(a), bits(b), n);
+}
+void scale(fix *out, const fix *a, fix k, std::size_t n) {
+  nds_kernel_scale(bits(out), bits(a), k.bits, n);
+}
+void distance_squared(fix *out, const fix *x, const fix *y, fix px, fix py,
+                      std::size_t n) {
+  nds_kernel_distance_squared(bits(out), bits(x), bits(y), px.bits, py.bits,
+                              n);
+}
+void integrate(fix *position, const fix *velocity, std::size_t n) {
+  nds_kernel_integrate(bits(position), bits(velocity), n);
+}
+
+#else
+
+void add(fix *a, const fix *b, std::size_t n) { portable::add(a, b, n); }
+void scale(fix *out, const fix *a, fix k, std::size_t n) {
+  portable::scale(out, a, k, n);
+}
+void distance_squared(fix *out, const fix *x, const fix *y, fix px, fix py,
+                      std::size_t n) {
+  portable::distance_squared(out, x, y, px, py, n);
+}
+void integrate(fix *position, const fix *velocity, std::size_t n) {
+  portable::integrate(position, velocity, n);
+}
+
+#endif
+
+/* verification */
+
+namespace {
+
+// An odd length, to reach the kernels' tail handling.
+constexpr std::size_t VERIFY_LENGTH = 67;
+using Values = std::array<fix, VERIFY_LENGTH>;
+
+constexpr int32_t EDGE_CASES[] = {
+    0,         1,          -1,          4096,          -4096,
+    INT32_MAX, INT32_MIN,  INT32_MAX - 1, INT32_MIN + 1, 0x7ffff000,
+    -0x7ffff000,
+    // Squares to just past the largest fix.
+    46341 << 12,
+};
+
+Values verify_values(uint32_t &state) {
+  Values values;
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    // xorshift32
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    values[i] = {i < std::size(EDGE_CASES)
+                     ? EDGE_CASES[i]
+                     : static_cast<int32_t>(state)};
+  }
+  return values;
+}
+
+bool same(const Values &a, const Values &b) {
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    if (a[i].bits != b[i].bits) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The references use fix's operators, and where those would overflow, what
+// the kernels promise instead.
+
+bool fits(int64_t value) { return INT32_MIN <= value and value <= INT32_MAX; }
+
+fix reference_add(fix a, fix b) {
+  const int64_t sum = int64_t{a.bits} + b.bits;
+  return fits(sum) ? a + b : fix{static_cast<int32_t>(sum)};
+}
+
+fix reference_subtract(fix a, fix b) {
+  const int64_t difference = int64_t{a.bits} - b.bits;
+  return fits(difference) ? a - b : fix{static_cast<int32_t>(difference)};
+}
+
+fix reference_integrate(fix a, fix b) {
+  const int64_t sum = int64_t{a.bits} + b.bits;
+  if (fits(sum)) {
+    return a + b;
+  }
+  return fix{sum > 0 ? INT32_MAX : INT32_MIN};
+}
+
+// d may be one more than with fix's operators, which round each square.
+bool distance_matches(fix d, fix x, fix y, fix px, fix py) {
+  const fix dx = reference_subtract(x, px);
+  const fix dy = reference_subtract(y, py);
+  const int64_t sum = (int64_t{dx.bits} * dx.bits >> 12) +
+                      (int64_t{dy.bits} * dy.bits >> 12);
+  if (sum >= INT32_MAX) {
+    return d.bits == INT32_MAX;
+  }
+  const fix expected = dx * dx + dy * dy;
+  return d.bits == expected.bits or d.bits == expected.bits + 1;
+}
+
+// Whether out is reference(a[i], b[i]) for i < n, and a beyond that.
+template <typename Reference>
+bool matches(const Values &out, const Values &a, const Values &b,
+             std::size_t n, Reference reference) {
+  for (std::size_t i = 0; i < out.size(); ++i) {
+    const fix expected = i < n ? reference(a[i], b[i]) : a[i];
+    if (out[i].bits != expected.bits) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+bool verify() {
+  uint32_t state = 0x12345678;
+  bool ok = true;
+  // Each round pairs the edge cases with different values.
+  for (int round = 0; round < 8; ++round) {
+    const Values a = verify_values(state);
+    Values b = verify_values(state);
+    // Later rounds use small values too, like real positions and speeds.
+    if (round % 2 == 1) {
+      for (fix &value : b) {
+        value.bits >>= 12;
+      }
+    }
+
+    // Short lengths, for every path through the loops' tails.
+    for (const std::size_t n : {std::size_t{0}, std::size_t{1}, std::size_t{2},
+                                std::size_t{3}, std::size_t{4},
+                                VERIFY_LENGTH}) {
+      Values fast = a;
+      Values slow = a;
+      add(fast.data(), b.data(), n);
+      portable::add(slow.data(), b.data(), n);
+      ok = ok and same(fast, slow) and matches(fast, a, b, n, reference_add);
+    }
+
+    Values fast = a;
+    Values slow = a;
+    integrate(fast.data(), b.data(), VERIFY_LENGTH);
+    portable::integrate(slow.data(), b.data(), VERIFY_LENGTH);
+    ok = ok and same(fast, slow) and
+         matches(fast, a, b, VERIFY_LENGTH, reference_integrate);
+
+    for (const int32_t k : {b[round].bits, b[VERIFY_LENGTH - 1 - round].bits,
+                            int32_t{3584}}) {
+      // In place, as callers use it.
+      fast = a;
+      slow = a;
+      scale(fast.data(), fast.data(), fix{k}, VERIFY_LENGTH);
+      portable::scale(slow.data(), slow.data(), fix{k}, VERIFY_LENGTH);
+      ok = ok and same(fast, slow);
+      for (std::size_t i = 0; i < VERIFY_LENGTH; ++i) {
+        ok = ok and fast[i].bits == (a[i] * fix{k}).bits;
+      }
+    }
+
+    for (const std::size_t point :
+         {static_cast<std::size_t>(round), VERIFY_LENGTH - 1}) {
+      distance_squared(fast.data(), a.data(), b.data(), a[point], b[point],
+                       VERIFY_LENGTH);
+      portable::distance_squared(slow.data(), a.data(), b.data(), a[point],
+                                 b[point], VERIFY_LENGTH);
+      ok = ok and same(fast, slow);
+      for (std::size_t i = 0; i < VERIFY_LENGTH; ++i) {
+        ok = ok and distance_matches(fast[i], a[i], b[i], a[point], b[point]);
+      }
+    }
+  }
+  return ok;
+}
+
+} // namespace kernels
+
 }; // namespace nds
@@ -0,0 +1,112 @@
+@ ARM implementations of the nds::kernels batch kernels (see ndspp.hpp), for
+@ the ARM946E-S. They go in ITCM with the rest of the hot code, and must give
+@ exactly the same results as the portable loops in ndspp.cpp.
+@
+@ Arrays of fix are arrays of 32-bit words. Lengths are element counts.
+
+	.arm
+	.section .itcm,"ax",%progbits
+	.align 2
+
+@ void nds_kernel_add(int32_t *a, const int32_t *b, size_t n)
+@ a[i] += b[i], wrapping. Two at a time.
+	.global nds_kernel_add
+	.type nds_kernel_add, %function
+nds_kernel_add:
+	subs	r2, r2, #2
+	blt	2f
+	push	{r4, r5}
+1:	ldmia	r0, {r3, r12}
+	ldmia	r1!, {r4, r5}
+	add	r3, r3, r4
+	add	r12, r12, r5
+	stmia	r0!, {r3, r12}
+	subs	r2, r2, #2
+	bge	1b
+	pop	{r4, r5}
+	@ r2 is -2 or -1: one element is left if it's -1.
+2:	adds	r2, r2, #2
+	bxeq	lr
+	ldr	r3, [r0]
+	ldr	r12, [r1]
+	add	r3, r3, r12
+	str	r3, [r0]
+	bx	lr
+	.size nds_kernel_add, . - nds_kernel_add
+
+@ void nds_kernel_integrate(int32_t *position, const int32_t *velocity,
+@                           size_t n)
+@ position[i] += velocity[i], saturating with QADD. Two at a time.
+	.global nds_kernel_integrate
+	.type nds_kernel_integrate, %function
+nds_kernel_integrate:
+	subs	r2, r2, #2
+	blt	2f
+	push	{r4, r5}
+1:	ldmia	r0, {r3, r12}
+	ldmia	r1!, {r4, r5}
+	qadd	r3, r3, r4
+	qadd	r12, r12, r5
+	stmia	r0!, {r3, r12}
+	subs	r2, r2, #2
+	bge	1b
+	pop	{r4, r5}
+2:	adds	r2, r2, #2
+	bxeq	lr
+	ldr	r3, [r0]
+	ldr	r12, [r1]
+	qadd	r3, r3, r12
+	str	r3, [r0]
+	bx	lr
+	.size nds_kernel_integrate, . - nds_kernel_integrate
+
+@ void nds_kernel_scale(int32_t *out, const int32_t *a, int32_t k, size_t n)
+@ out[i] = (a[i] * k) >> 12, from the 64-bit product like mulf32. out may
+@ be a.
+	.global nds_kernel_scale
+	.type nds_kernel_scale, %function
+nds_kernel_scale:
+	cmp	r3, #0
+	bxeq	lr
+	push	{r4, r5}
+1:	ldr	r12, [r1], #4
+	smull	r4, r5, r12, r2
+	mov	r4, r4, lsr #12
+	orr	r4, r4, r5, lsl #20
+	str	r4, [r0], #4
+	subs	r3, r3, #1
+	bne	1b
+	pop	{r4, r5}
+	bx	lr
+	.size nds_kernel_scale, . - nds_kernel_scale
+
+@ void nds_kernel_distance_squared(int32_t *out, const int32_t *x,
+@                                  const int32_t *y, int32_t px, int32_t py,
+@                                  size_t n)
+@ out[i] = ((x[i] - px)^2 + (y[i] - py)^2) >> 12, summed at 64 bits with
+@ SMULL and SMLAL, and saturated to INT32_MAX. The sum is at most 2^63, so
+@ it's unsigned, and fits in 31 bits after the shift if its top word is
+@ below 2^11.
+	.global nds_kernel_distance_squared
+	.type nds_kernel_distance_squared, %function
+nds_kernel_distance_squared:
+	push	{r4-r8, lr}
+	ldr	r4, [sp, #24]		@ py
+	ldr	r5, [sp, #28]		@ n
+	cmp	r5, #0
+	beq	2f
+1:	ldr	r6, [r1], #4
+	ldr	r7, [r2], #4
+	sub	r6, r6, r3
+	sub	r7, r7, r4
+	smull	r8, lr, r6, r6
+	smlal	r8, lr, r7, r7
+	cmp	lr, #0x800
+	mvnhs	r8, #0x80000000
+	movlo	r8, r8, lsr #12
+	orrlo	r8, r8, lr, lsl #20
+	str	r8, [r0], #4
+	subs	r5, r5, #1
+	bne	1b
+2:	pop	{r4-r8, pc}
+	.size nds_kernel_distance_squared, . - nds_kernel_distance_squared
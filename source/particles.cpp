@@ -0,0 +1,181 @@
+#include "particles.hpp"
+#include "components.hpp"
+#include "ndspp.hpp"
+#include "stats.hpp"
+#include "tcm.hpp"
+#include "tecs.hpp"
+#include <algorithm>
+#include <cassert>
+#include <nds.h>
+#include <nds/arm9/sprite.h>
+
+extern ParticlePool particle_pool;
+
+using namespace Tecs;
+
+// Particles get their own random numbers, so effects don't change the game's
+// sequence of rand() values.
+static uint32_t random_state = 0x2545f491;
+
+static uint32_t random_bits() {
+  // xorshift32
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+// A random fix in [-1, 1).
+static nds::fix random_unit() {
+  return {static_cast<int32_t>(random_bits() & 0x1fff) - 0x1000};
+}
+
+ParticleSprites::ParticleSprites(OamState *oam, const SpriteData &source)
+    : oam{oam}, palette_index{source.palette_index} {
+  assert(source.size == SpriteSize_8x8 and
+         source.color_format == SpriteColorFormat_256Color);
+  for (int frame = 0; frame < PARTICLE_FRAMES; ++frame) {
+    tiles[frame] =
+        oamAllocateGfx(oam, SpriteSize_8x8, SpriteColorFormat_256Color);
+    // Radius in half pixels from the centre of the tile: 4.5, 3.5, 2.5, 1.5.
+    const int radius = 9 - 2 * frame;
+    // VRAM only takes 16-bit writes, so pixels go in pairs.
+    for (int pixel = 0; pixel < 64; pixel += 2) {
+      uint16_t pair = 0;
+      for (int half = 0; half < 2; ++half) {
+        const int x = 2 * ((pixel + half) % 8) - 7;
+        const int y = 2 * ((pixel + half) / 8) - 7;
+        if (x * x + y * y <= radius * radius) {
+          pair |= source.gfx[pixel + half] << (8 * half);
+        }
+      }
+      tiles[frame][pixel / 2] = pair;
+    }
+  }
+}
+
+ParticleSprites::~ParticleSprites() {
+  for (uint16_t *tile : tiles) {
+    oamFreeGfx(oam, tile);
+  }
+}
+
+void ParticleSprites::reserve(SpriteIdManager &sprite_id_manager) {
+  id_count = 0;
+  while (id_count < PARTICLE_SPRITES) {
+    const auto id = sprite_id_manager.reserve();
+    if (not id) {
+      break;
+    }
+    ids[id_count++] = *id;
+  }
+}
+
+void emit_particle(ParticlePool &pool, const Vec3 &position,
+                   const Vec3 &velocity, uint16_t life) {
+  if (pool.count == PARTICLE_CAPACITY) {
+    pool.dropped++;
+    return;
+  }
+  const std::size_t i = pool.count++;
+  pool.x[i] = position.x;
+  pool.y[i] = position.y;
+  pool.vx[i] = velocity.x;
+  pool.vy[i] = velocity.y;
+  pool.life[i] = life;
+  pool.frame[i] = 0;
+}
+
+void emit_burst(ParticlePool &pool, const Vec3 &position, int count,
+                nds::fix speed, uint16_t life) {
+  // Don't bother picking directions for particles that won't fit.
+  const int room = static_cast<int>(PARTICLE_CAPACITY - pool.count);
+  if (count > room) {
+    pool.dropped += count - room;
+    count = room;
+  }
+  for (int n = 0; n < count; ++n) {
+    // Pick a point in the unit circle, for an even spread of directions.
+    nds::fix x, y;
+    do {
+      x = random_unit();
+      y = random_unit();
+    } while (x * x + y * y > nds::fix::from_int(1));
+    // Vary lifetimes a little, so a burst doesn't vanish all at once.
+    const uint16_t jitter = random_bits() % (life / 4 + 1);
+    emit_particle(pool, position, Vec3{x * speed, y * speed, {0}},
+                  life - jitter);
+  }
+}
+
+HOT_CODE void update_particles(ParticlePool &pool) {
+  // Drag: lose an eighth of the speed each frame.
+  constexpr nds::fix DRAG = nds::fix::from_float(0.875f);
+  nds::kernels::integrate(pool.x.data(), pool.vx.data(), pool.count);
+  nds::kernels::integrate(pool.y.data(), pool.vy.data(), pool.count);
+  nds::kernels::scale(pool.vx.data(), pool.vx.data(), DRAG, pool.count);
+  nds::kernels::scale(pool.vy.data(), pool.vy.data(), DRAG, pool.count);
+
+  std::size_t i = 0;
+  while (i < pool.count) {
+    if (--pool.life[i] == 0) {
+      const std::size_t last = --pool.count;
+      pool.x[i] = pool.x[last];
+      pool.y[i] = pool.y[last];
+      pool.vx[i] = pool.vx[last];
+      pool.vy[i] = pool.vy[last];
+      pool.life[i] = pool.life[last];
+      pool.frame[i] = pool.frame[last];
+      continue;
+    }
+    // Shrink over the last four frames per tile.
+    const uint16_t age_frame = pool.life[i] / 4;
+    pool.frame[i] = age_frame >= PARTICLE_FRAMES - 1
+                        ? 0
+                        : PARTICLE_FRAMES - 1 - age_frame;
+    ++i;
+  }
+  STAT_SET(ParticlesLive, pool.count);
+}
+
+void draw_particles(const ParticlePool &pool, const ParticleSprites &sprites,
+                    const Camera &camera) {
+  // New particles are at the end, so when there are too many to draw, these
+  // are roughly the newest.
+  int slot = 0;
+  for (std::size_t i = pool.count; i > 0 and slot < sprites.id_count; --i) {
+    // Tiles are 8x8, centred on the particle.
+    const int32_t x = static_cast<int32_t>(pool.x[i - 1] - camera.x) - 4;
+    const int32_t y = static_cast<int32_t>(pool.y[i - 1] - camera.y) - 4;
+    if (x <= -8 or x >= SCREEN_WIDTH or y <= -8 or y >= SCREEN_HEIGHT) {
+      continue;
+    }
+    oamSet(sprites.oam, sprites.ids[slot++], x, y, 0, sprites.palette_index,
+           SpriteSize_8x8, SpriteColorFormat_256Color,
+           sprites.tiles[pool.frame[i - 1]], -1, false, false, false, false,
+           false);
+  }
+  for (; slot < sprites.id_count; ++slot) {
+    oamSetHidden(sprites.oam, sprites.ids[slot], true);
+  }
+}
+
+void particle_trails(Coordinator &ecs,
+                     const std::unordered_set<Entity> &entities) {
+  constexpr uint16_t TRAIL_LIFE = 16;
+  for (const Entity entity : entities) {
+    ParticleTrail &trail = lookup<ParticleTrail>(ecs, entity);
+    if (++trail.clock < trail.period) {
+      continue;
+    }
+    trail.clock = 0;
+    const Vec3 &position = lookup<Position>(ecs, entity).pos;
+    const Vec3 &velocity = lookup<Velocity>(ecs, entity).v;
+    // Drift back the way the entity came, and a little to either side, at a
+    // quarter of its speed.
+    const Vec3 drift = {{(random_unit().bits - velocity.x.bits) >> 2},
+                        {(random_unit().bits - velocity.y.bits) >> 2},
+                        {0}};
+    emit_particle(particle_pool, position, drift, TRAIL_LIFE);
+  }
+}
@@ -0,0 +1,150 @@
+#include "scheduler.hpp"
+
+#ifdef MAGIC_BATTLE_PARALLEL
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace scheduler {
+
+namespace {
+
+class Pool {
+public:
+  explicit Pool(std::size_t count) {
+    threads.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      threads.emplace_back([this] { serve(); });
+    }
+  }
+
+  ~Pool() {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+
+  std::size_t size() const { return threads.size(); }
+
+  void run(std::size_t count, Task task, void *context) {
+    {
+      // A worker that woke too late for the last job may still be on its way
+      // out of it.
+      std::unique_lock lock(mutex);
+      done.wait(lock, [this] { return active == 0; });
+      job = {task, context, count};
+      next = 0;
+      remaining = count;
+      generation++;
+    }
+    wake.notify_all();
+    work();
+    std::unique_lock lock(mutex);
+    done.wait(lock, [this] { return remaining == 0 and active == 0; });
+  }
+
+private:
+  struct Job {
+    Task task;
+    void *context;
+    std::size_t count;
+  };
+
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  Job job{};
+  std::atomic<std::size_t> next = 0;
+  std::atomic<std::size_t> remaining = 0;
+  // Workers inside work().
+  std::size_t active = 0;
+  uint64_t generation = 0;
+  bool stopping = false;
+
+  void serve() {
+    uint64_t seen = 0;
+    std::unique_lock lock(mutex);
+    while (true) {
+      wake.wait(lock, [&] { return stopping or generation != seen; });
+      if (stopping) {
+        return;
+      }
+      seen = generation;
+      active++;
+      lock.unlock();
+      work();
+      lock.lock();
+      active--;
+      done.notify_all();
+    }
+  }
+
+  void work();
+};
+
+// Set while running a task, so tasks that start more run them in place.
+thread_local bool in_task = false;
+
+void Pool::work() {
+  in_task = true;
+  for (std::size_t index = next++; index < job.count; index = next++) {
+    job.task(job.context, index);
+    if (--remaining == 0) {
+      std::lock_guard lock(mutex);
+      done.notify_all();
+    }
+  }
+  in_task = false;
+}
+
+std::size_t default_workers() {
+  const unsigned hardware = std::thread::hardware_concurrency();
+  return hardware > 1 ? hardware - 1 : 0;
+}
+
+std::unique_ptr<Pool> pool;
+
+Pool &get_pool() {
+  if (pool == nullptr) {
+    pool = std::make_unique<Pool>(default_workers());
+  }
+  return *pool;
+}
+
+} // namespace
+
+void run(std::size_t count, Task task, void *context) {
+  if (count == 0) {
+    return;
+  }
+  Pool &threads = get_pool();
+  if (count == 1 or in_task or threads.size() == 0) {
+    for (std::size_t i = 0; i < count; ++i) {
+      task(context, i);
+    }
+    return;
+  }
+  threads.run(count, task, context);
+}
+
+std::size_t workers() { return get_pool().size(); }
+
+void set_workers(std::size_t count) {
+  pool.reset();
+  pool = std::make_unique<Pool>(count);
+}
+
+} // namespace scheduler
+
+#endif
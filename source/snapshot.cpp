@@ -0,0 +1,552 @@
+#include "snapshot.hpp"
+#include "components.hpp"
+#include "stats.hpp"
+#include "tecs.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <nds.h>
+#include <nds/timers.h>
+#include <type_traits>
+
+using namespace Tecs;
+
+namespace {
+
+// Section kinds, in restore order: Position comes first because make_sprite
+// may need to look at other sprites' positions to evict one.
+enum class SectionKind : uint8_t {
+  Position,
+  Velocity,
+  Health,
+  Following,
+  Collision,
+  TimerCallback,
+  Zombie,
+  DeathMark,
+  SpriteInfo,
+  ChunkCell,
+  ParticleTrail,
+};
+
+using CollisionFunction = void (*)(Coordinator &, Entity, Entity);
+using TimerFunction = void (*)(Coordinator &, Entity);
+
+// Every callback a snapshot can refer to, by index.
+constexpr CollisionFunction COLLISION_CALLBACKS[] = {take_damage};
+constexpr TimerFunction TIMER_CALLBACKS[] = {self_destruct};
+
+template <typename F, std::size_t N>
+uint8_t callback_index(const F (&table)[N], const F *target) {
+  assert(target != nullptr);
+  const auto found = std::find(std::begin(table), std::end(table), *target);
+  assert(found != std::end(table));
+  return static_cast<uint8_t>(found - std::begin(table));
+}
+
+class Writer {
+  std::vector<uint8_t> &bytes;
+
+public:
+  explicit Writer(std::vector<uint8_t> &bytes) : bytes{bytes} {}
+
+  template <typename T> void put(const T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const auto *first = reinterpret_cast<const uint8_t *>(&value);
+    bytes.insert(bytes.end(), first, first + sizeof(T));
+  }
+  void put(std::span<const uint8_t> data) {
+    bytes.insert(bytes.end(), data.begin(), data.end());
+  }
+};
+
+// Reading past the end, or fail()ing on bad data, leaves a Reader failed:
+// every get() after that returns zeroes.
+class Reader {
+  const uint8_t *position;
+  const uint8_t *end;
+  bool failed_ = false;
+
+public:
+  explicit Reader(const std::vector<uint8_t> &bytes)
+      : position{bytes.data()}, end{bytes.data() + bytes.size()} {}
+
+  bool has(std::size_t length) const {
+    return static_cast<std::size_t>(end - position) >= length;
+  }
+  bool at_end() const { return position == end; }
+  bool failed() const { return failed_; }
+  void fail() {
+    failed_ = true;
+    position = end;
+  }
+
+  template <typename T> T get() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value{};
+    if (not has(sizeof(T))) {
+      fail();
+      return value;
+    }
+    std::memcpy(&value, position, sizeof(T));
+    position += sizeof(T);
+    return value;
+  }
+  void get(std::span<uint8_t> data) {
+    if (not has(data.size())) {
+      fail();
+      return;
+    }
+    std::memcpy(data.data(), position, data.size());
+    position += data.size();
+  }
+  void skip(std::size_t length) {
+    if (not has(length)) {
+      fail();
+      return;
+    }
+    position += length;
+  }
+  // An index into a table of count entries.
+  uint8_t get_index(std::size_t count) {
+    const auto index = get<uint8_t>();
+    if (index >= count) {
+      fail();
+      return 0;
+    }
+    return index;
+  }
+};
+
+struct Header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t entity_count;
+  uint8_t section_count;
+};
+
+// What encoders and decoders need besides the component itself.
+struct Context {
+  // Captured entity IDs, sorted: an entity is stored as its index in here.
+  std::vector<Entity> old_entities;
+  // New entity for each index in old_entities.
+  std::vector<Entity> new_entities;
+  std::span<SpriteData *const> sprites;
+  SpriteIdManager *sprite_id_manager = nullptr;
+  uint32_t now = 0;
+
+  uint16_t index_of(Entity entity) const {
+    const auto found = std::lower_bound(old_entities.begin(),
+                                        old_entities.end(), entity);
+    assert(found != old_entities.end() and *found == entity);
+    return static_cast<uint16_t>(found - old_entities.begin());
+  }
+};
+
+/* codecs: how each component is stored */
+
+// Each codec read()s an entry into a Value, failing the Reader on bad data,
+// so a whole blob can be checked before apply() adds anything to the world.
+
+// Components stored as their bytes.
+template <typename T, SectionKind K> struct PodCodec {
+  static constexpr SectionKind KIND = K;
+  using Value = T;
+  static void encode(Writer &out, const T &value, const Context &) {
+    out.put(value);
+  }
+  static Value read(Reader &in, const Context &) { return in.get<T>(); }
+  static void apply(Coordinator &ecs, Entity entity, const Value &value,
+                    const Context &) {
+    add_components(ecs, entity, value);
+  }
+};
+
+// Tags have no data.
+template <typename T, SectionKind K> struct TagCodec {
+  static constexpr SectionKind KIND = K;
+  using Value = T;
+  static void encode(Writer &, const T &, const Context &) {}
+  static Value read(Reader &, const Context &) { return {}; }
+  static void apply(Coordinator &ecs, Entity entity, const Value &,
+                    const Context &) {
+    add_components(ecs, entity, T{});
+  }
+};
+
+template <typename T> struct Codec;
+template <>
+struct Codec<Position> : PodCodec<Position, SectionKind::Position> {};
+template <>
+struct Codec<Velocity> : PodCodec<Velocity, SectionKind::Velocity> {};
+template <> struct Codec<Health> : PodCodec<Health, SectionKind::Health> {};
+template <> struct Codec<Zombie> : TagCodec<Zombie, SectionKind::Zombie> {};
+template <>
+struct Codec<DeathMark> : TagCodec<DeathMark, SectionKind::DeathMark> {};
+
+template <> struct Codec<Following> {
+  static constexpr SectionKind KIND = SectionKind::Following;
+  static void encode(Writer &out, const Following &following,
+                     const Context &context) {
+    out.put(context.index_of(following.target));
+    out.put(following.speed);
+  }
+  struct Value {
+    uint16_t target;
+    nds::fix speed;
+  };
+  static Value read(Reader &in, const Context &context) {
+    const auto target = in.get<uint16_t>();
+    if (target >= context.old_entities.size()) {
+      in.fail();
+    }
+    return {target, in.get<nds::fix>()};
+  }
+  static void apply(Coordinator &ecs, Entity entity, const Value &value,
+                    const Context &context) {
+    add_components(
+        ecs, entity,
+        Following{context.new_entities[value.target], value.speed});
+  }
+};
+
+template <> struct Codec<Collision> {
+  static constexpr SectionKind KIND = SectionKind::Collision;
+  static void encode(Writer &out, const Collision &collision,
+                     const Context &) {
+    out.put(static_cast<uint8_t>(collision.mask.to_ulong()));
+    out.put(static_cast<uint8_t>(collision.layer.to_ulong()));
+    out.put(collision.radius_squared);
+    out.put(callback_index(COLLISION_CALLBACKS,
+                           collision.callback.target<CollisionFunction>()));
+  }
+  using Value = Collision;
+  static Value read(Reader &in, const Context &) {
+    const auto mask = in.get<uint8_t>();
+    const auto layer = in.get<uint8_t>();
+    const auto radius_squared = in.get<nds::fix>();
+    return {mask, layer, radius_squared,
+            COLLISION_CALLBACKS[in.get_index(std::size(COLLISION_CALLBACKS))]};
+  }
+  static void apply(Coordinator &ecs, Entity entity, const Value &value,
+                    const Context &) {
+    add_components(ecs, entity, value);
+  }
+};
+
+template <> struct Codec<TimerCallback> {
+  static constexpr SectionKind KIND = SectionKind::TimerCallback;
+  // Timer deadlines are stored relative to the capture time.
+  static void encode(Writer &out, const TimerCallback &timer,
+                     const Context &context) {
+    const int32_t remaining = static_cast<int32_t>(timer.time - context.now);
+    out.put(static_cast<uint32_t>(std::max<int32_t>(remaining, 0)));
+    out.put(callback_index(TIMER_CALLBACKS,
+                           timer.callback.target<TimerFunction>()));
+  }
+  using Value = TimerCallback;
+  static Value read(Reader &in, const Context &context) {
+    const uint32_t time = context.now + in.get<uint32_t>();
+    return {time, TIMER_CALLBACKS[in.get_index(std::size(TIMER_CALLBACKS))]};
+  }
+  static void apply(Coordinator &ecs, Entity entity, const Value &value,
+                    const Context &) {
+    add_components(ecs, entity, value);
+  }
+};
+
+template <> struct Codec<SpriteInfo> {
+  static constexpr SectionKind KIND = SectionKind::SpriteInfo;
+  // The slot and sizes come back from make_sprite.
+  static void encode(Writer &out, const SpriteInfo &sprite_info,
+                     const Context &context) {
+    const auto found = std::find(context.sprites.begin(),
+                                 context.sprites.end(), sprite_info.sprite);
+    assert(found != context.sprites.end());
+    out.put(static_cast<uint8_t>(found - context.sprites.begin()));
+  }
+  using Value = SpriteData *;
+  static Value read(Reader &in, const Context &context) {
+    const uint8_t index = in.get_index(context.sprites.size());
+    return in.failed() ? nullptr : context.sprites[index];
+  }
+  static void apply(Coordinator &ecs, Entity entity, const Value &value,
+                    const Context &context) {
+    make_sprite(ecs, entity, *context.sprite_id_manager, *value);
+  }
+};
+
+template <> struct Codec<ChunkCell> {
+  static constexpr SectionKind KIND = SectionKind::ChunkCell;
+  // Restored entities start awake and unfiled, and chunk_tracking files them
+  // (and puts them back to sleep) on the next physics run.
+  using Value = ChunkCell;
+  static void encode(Writer &, const ChunkCell &, const Context &) {}
+  static Value read(Reader &, const Context &) { return {NO_CHUNK}; }
+  static void apply(Coordinator &ecs, Entity entity, const Value &value,
+                    const Context &) {
+    add_components(ecs, entity, value, Awake{});
+  }
+};
+
+template <>
+struct Codec<ParticleTrail>
+    : PodCodec<ParticleTrail, SectionKind::ParticleTrail> {};
+
+/* sections */
+
+struct Section {
+  SectionKind kind;
+  std::vector<Entity> entities;
+};
+
+struct CaptureState {
+  std::span<SpriteData *const> sprites;
+  std::vector<Section> sections;
+};
+CaptureState capture_state;
+
+template <typename T>
+void encode_section(Writer &out, Coordinator &ecs, const Section &section,
+                    const Context &context) {
+  for (const Entity entity : section.entities) {
+    out.put(context.index_of(entity));
+    Codec<T>::encode(out, lookup<T>(ecs, entity), context);
+  }
+}
+
+// Read a section's entries, adding them to the new entities unless ecs is
+// null, when it only checks them.
+template <typename T>
+void decode_section(Reader &in, Coordinator *ecs, uint16_t count,
+                    const Context &context) {
+  for (uint16_t i = 0; i < count and not in.failed(); ++i) {
+    const auto index = in.get<uint16_t>();
+    if (index >= context.old_entities.size()) {
+      in.fail();
+    }
+    const auto value = Codec<T>::read(in, context);
+    if (ecs != nullptr and not in.failed()) {
+      Codec<T>::apply(*ecs, context.new_entities[index], value, context);
+    }
+  }
+}
+
+// Call f.template operator()<T>() with the component type of a section kind.
+template <typename F> void with_component_type(SectionKind kind, F &&f) {
+  switch (kind) {
+  case SectionKind::Position:
+    return f.template operator()<Position>();
+  case SectionKind::Velocity:
+    return f.template operator()<Velocity>();
+  case SectionKind::Health:
+    return f.template operator()<Health>();
+  case SectionKind::Following:
+    return f.template operator()<Following>();
+  case SectionKind::Collision:
+    return f.template operator()<Collision>();
+  case SectionKind::TimerCallback:
+    return f.template operator()<TimerCallback>();
+  case SectionKind::Zombie:
+    return f.template operator()<Zombie>();
+  case SectionKind::DeathMark:
+    return f.template operator()<DeathMark>();
+  case SectionKind::SpriteInfo:
+    return f.template operator()<SpriteInfo>();
+  case SectionKind::ChunkCell:
+    return f.template operator()<ChunkCell>();
+  case SectionKind::ParticleTrail:
+    return f.template operator()<ParticleTrail>();
+  }
+  assert(false);
+}
+
+bool known_kind(SectionKind kind) {
+  return kind <= SectionKind::ParticleTrail;
+}
+
+// Header fields are written one by one to leave out the padding.
+constexpr std::size_t HEADER_SIZE = sizeof(Header::magic) +
+                                    sizeof(Header::version) +
+                                    sizeof(Header::entity_count) +
+                                    sizeof(Header::section_count);
+
+void write_header(Writer &out, const Header &header) {
+  out.put(header.magic);
+  out.put(header.version);
+  out.put(header.entity_count);
+  out.put(header.section_count);
+}
+
+bool read_header(Reader &in, Header &header) {
+  if (not in.has(HEADER_SIZE)) {
+    return false;
+  }
+  header.magic = in.get<uint32_t>();
+  header.version = in.get<uint16_t>();
+  header.entity_count = in.get<uint16_t>();
+  header.section_count = in.get<uint8_t>();
+  return header.magic == Snapshot::MAGIC and
+         header.version == Snapshot::VERSION and
+         in.has(header.entity_count * sizeof(Entity));
+}
+
+} // namespace
+
+template <typename T>
+void capture_component(Coordinator &ecs,
+                       const std::unordered_set<Entity> &entities) {
+  std::ignore = ecs;
+  capture_state.sections.push_back(
+      {Codec<T>::KIND, {entities.begin(), entities.end()}});
+}
+
+template void capture_component<Position>(Coordinator &,
+                                          const std::unordered_set<Entity> &);
+template void capture_component<Velocity>(Coordinator &,
+                                          const std::unordered_set<Entity> &);
+template void capture_component<Health>(Coordinator &,
+                                        const std::unordered_set<Entity> &);
+template void capture_component<Following>(Coordinator &,
+                                           const std::unordered_set<Entity> &);
+template void capture_component<Collision>(Coordinator &,
+                                           const std::unordered_set<Entity> &);
+template void
+capture_component<TimerCallback>(Coordinator &,
+                                 const std::unordered_set<Entity> &);
+template void capture_component<Zombie>(Coordinator &,
+                                        const std::unordered_set<Entity> &);
+template void capture_component<DeathMark>(Coordinator &,
+                                           const std::unordered_set<Entity> &);
+template void capture_component<SpriteInfo>(Coordinator &,
+                                            const std::unordered_set<Entity> &);
+template void capture_component<ChunkCell>(Coordinator &,
+                                           const std::unordered_set<Entity> &);
+template void
+capture_component<ParticleTrail>(Coordinator &,
+                                 const std::unordered_set<Entity> &);
+
+// Every entity in the captured sections, sorted.
+static std::vector<Entity> captured_entities() {
+  std::vector<Entity> entities;
+  for (const Section &section : capture_state.sections) {
+    entities.insert(entities.end(), section.entities.begin(),
+                    section.entities.end());
+  }
+  std::sort(entities.begin(), entities.end());
+  entities.erase(std::unique(entities.begin(), entities.end()),
+                 entities.end());
+  return entities;
+}
+
+namespace snapshot_detail {
+void begin_capture(std::span<SpriteData *const> sprites) {
+  capture_state.sprites = sprites;
+  capture_state.sections.clear();
+}
+
+std::vector<Entity> end_listing() {
+  std::vector<Entity> entities = captured_entities();
+  capture_state.sections.clear();
+  return entities;
+}
+
+Snapshot end_capture(Coordinator &ecs, std::span<const uint8_t> extra) {
+  auto &sections = capture_state.sections;
+  std::sort(sections.begin(), sections.end(),
+            [](const Section &a, const Section &b) { return a.kind < b.kind; });
+
+  Context context;
+  context.sprites = capture_state.sprites;
+  context.now = cpuGetTiming();
+  context.old_entities = captured_entities();
+  assert(context.old_entities.size() <= UINT16_MAX);
+
+  Snapshot snapshot;
+  Writer out{snapshot.bytes};
+  write_header(out, Header{Snapshot::MAGIC, Snapshot::VERSION,
+                          static_cast<uint16_t>(context.old_entities.size()),
+                          static_cast<uint8_t>(sections.size())});
+  for (const Entity entity : context.old_entities) {
+    out.put(entity);
+  }
+  for (const Section &section : sections) {
+    out.put(section.kind);
+    out.put(static_cast<uint16_t>(section.entities.size()));
+    with_component_type(section.kind, [&]<typename T>() {
+      encode_section<T>(out, ecs, section, context);
+    });
+  }
+  out.put(static_cast<uint16_t>(extra.size()));
+  out.put(extra);
+
+  sections.clear();
+  return snapshot;
+}
+} // namespace snapshot_detail
+
+bool restore_snapshot(Coordinator &ecs, const Snapshot &snapshot,
+                      SpriteIdManager &sprite_id_manager,
+                      std::span<SpriteData *const> sprites,
+                      std::unordered_map<Entity, Entity> &old_to_new,
+                      std::span<uint8_t> extra) {
+  Context context;
+  context.sprites = sprites;
+  context.sprite_id_manager = &sprite_id_manager;
+  context.now = cpuGetTiming();
+
+  // Read the whole blob through once without touching the world, so a bad
+  // one changes nothing.
+  Header header;
+  {
+    Reader in{snapshot.bytes};
+    if (not read_header(in, header)) {
+      return false;
+    }
+    for (uint16_t i = 0; i < header.entity_count; ++i) {
+      context.old_entities.push_back(in.get<Entity>());
+    }
+    for (uint8_t i = 0; i < header.section_count and not in.failed(); ++i) {
+      const auto kind = in.get<SectionKind>();
+      const auto count = in.get<uint16_t>();
+      if (not known_kind(kind)) {
+        in.fail();
+        break;
+      }
+      with_component_type(kind, [&]<typename T>() {
+        decode_section<T>(in, nullptr, count, context);
+      });
+    }
+    const auto extra_length = in.get<uint16_t>();
+    if (extra_length != extra.size()) {
+      in.fail();
+    }
+    in.skip(extra_length);
+    if (in.failed() or not in.at_end()) {
+      return false;
+    }
+  }
+
+  Reader in{snapshot.bytes};
+  read_header(in, header);
+  old_to_new.clear();
+  for (const Entity old_entity : context.old_entities) {
+    in.get<Entity>();
+    const Entity new_entity = ecs.newEntity();
+    context.new_entities.push_back(new_entity);
+    old_to_new[old_entity] = new_entity;
+  }
+  STAT_ADD(EntitiesCreated, header.entity_count);
+
+  for (uint8_t i = 0; i < header.section_count; ++i) {
+    const auto kind = in.get<SectionKind>();
+    const auto count = in.get<uint16_t>();
+    with_component_type(kind, [&]<typename T>() {
+      decode_section<T>(in, &ecs, count, context);
+    });
+  }
+  in.get<uint16_t>();
+  in.get(extra);
+  return true;
+}
@@ -0,0 +1,65 @@
+#include "spawn_governor.hpp"
+#include <algorithm>
+
+void SpawnGovernor::reset() {
+  queued_ = 0;
+  frame_cost_ = 0;
+  limit_ = Limit::None;
+  report_ = {};
+}
+
+void SpawnGovernor::request() {
+  report_.requested++;
+  if (queued_ == MAX_QUEUED) {
+    report_.dropped++;
+    return;
+  }
+  queued_++;
+}
+
+void SpawnGovernor::observe(uint32_t frame_ticks) {
+  // An average over the last eight or so frames, so one slow frame doesn't
+  // stop spawning.
+  frame_cost_ = frame_cost_ - frame_cost_ / 8 + frame_ticks / 8;
+}
+
+int SpawnGovernor::release(std::size_t free_sprites, std::size_t population) {
+  limit_ = Limit::None;
+  if (queued_ == 0) {
+    return 0;
+  }
+
+  int batch = std::min(queued_, MAX_BATCH);
+  if (frame_cost_ > HIGH_WATER) {
+    batch = 0;
+    limit_ = Limit::FrameTime;
+  } else if (frame_cost_ > LOW_WATER and batch > 1) {
+    batch = 1;
+    limit_ = Limit::FrameTime;
+  }
+
+  const int sprite_room =
+      free_sprites > SPRITE_HEADROOM
+          ? static_cast<int>(free_sprites - SPRITE_HEADROOM)
+          : 0;
+  if (batch > sprite_room) {
+    batch = sprite_room;
+    limit_ = Limit::Sprites;
+  }
+
+  const int population_room =
+      population < MAX_POPULATION
+          ? static_cast<int>(MAX_POPULATION - population)
+          : 0;
+  if (batch > population_room) {
+    batch = population_room;
+    limit_ = Limit::Population;
+  }
+
+  if (limit_ != Limit::None) {
+    report_.capped_frames++;
+  }
+  queued_ -= batch;
+  report_.spawned += batch;
+  return batch;
+}
@@ -0,0 +1,69 @@
+#include "sprite_sort.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <nds.h>
+
+void SpriteSorter::reset(const SpriteIdManager &sprite_id_manager) {
+  entry_count = 0;
+  for (int id = 0; id < SPRITE_COUNT; ++id) {
+    if (not sprite_id_manager.ids.allocated(id) or
+        sprite_id_manager.priorities[id] != SpriteIdManager::RESERVED) {
+      entries[entry_count++] = static_cast<uint8_t>(id);
+    }
+  }
+  written.fill(UNKNOWN);
+  added_count = 0;
+}
+
+void SpriteSorter::add(const SpriteData &sprite, int x, int y, int row) {
+  // Every drawn sprite holds a slot, so this can only happen if slots were
+  // reserved after reset().
+  if (added_count == entry_count) {
+    return;
+  }
+  added[added_count] = {&sprite, static_cast<int16_t>(x),
+                        static_cast<int16_t>(y)};
+  rows[added_count] = static_cast<uint8_t>(row);
+  added_count++;
+}
+
+void SpriteSorter::commit(OamState *oam) {
+  // Counting sort, bottom row first. Sprites on the same row keep the order
+  // they were added in.
+  std::array<uint8_t, SPRITE_COUNT> order;
+  std::array<uint16_t, SCREEN_HEIGHT> starts{};
+  for (int i = 0; i < added_count; ++i) {
+    starts[rows[i]]++;
+  }
+  uint16_t start = 0;
+  for (int row = SCREEN_HEIGHT - 1; row >= 0; --row) {
+    const uint16_t count = starts[row];
+    starts[row] = start;
+    start += count;
+  }
+  for (int i = 0; i < added_count; ++i) {
+    order[starts[rows[i]]++] = static_cast<uint8_t>(i);
+  }
+
+  for (int n = 0; n < entry_count; ++n) {
+    const int entry = entries[n];
+    const Entry &want = n < added_count ? added[order[n]] : Entry{};
+    Entry &have = written[entry];
+    if (want == have) {
+      continue;
+    }
+    STAT_INC(OamWrites);
+    if (want.sprite == nullptr) {
+      oamClearSprite(oam, entry);
+    } else if (want.sprite == have.sprite) {
+      oamSetXY(oam, entry, want.x, want.y);
+    } else {
+      const SpriteData &sprite = *want.sprite;
+      oamSet(oam, entry, want.x, want.y, 0, sprite.palette_index, sprite.size,
+             sprite.color_format, sprite.vram_memory, -1, false, false, false,
+             false, false);
+    }
+    have = want;
+  }
+  added_count = 0;
+}
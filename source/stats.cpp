@@ -0,0 +1,114 @@
+#include "stats.hpp"
+#include <algorithm>
+#include <cstdio>
+
+#ifdef MAGIC_BATTLE_PARALLEL
+#include <mutex>
+#endif
+
+#ifdef MAGIC_BATTLE_STATS
+
+namespace stats {
+
+Frame current;
+
+static Frame last;
+static Frame total;
+static uint32_t frame_count = 0;
+
+static bool sampled(std::size_t counter) {
+  return counter == static_cast<std::size_t>(Counter::SpritesInUse) or
+         counter == static_cast<std::size_t>(Counter::ParticlesLive) or
+         counter == static_cast<std::size_t>(Counter::HotArenaPeak);
+}
+
+// The entry for a system in frame, added if it isn't there yet.
+static SystemCount *system_entry(Frame &frame, const char *name) {
+  const auto begin = frame.systems.begin();
+  const auto end = begin + frame.system_count;
+  const auto found =
+      std::find_if(begin, end, [name](const SystemCount &count) {
+        return count.name == name;
+      });
+  if (found != end) {
+    return &*found;
+  }
+  if (frame.system_count == MAX_SYSTEMS) {
+    return nullptr;
+  }
+  frame.systems[frame.system_count] = {name, 0};
+  return &frame.systems[frame.system_count++];
+}
+
+void record_system(const char *name, std::size_t entities) {
+#ifdef MAGIC_BATTLE_PARALLEL
+  static std::mutex mutex;
+  std::lock_guard lock(mutex);
+#endif
+  if (SystemCount *count = system_entry(current, name)) {
+    count->entities += static_cast<uint32_t>(entities);
+  }
+}
+
+void end_frame() {
+  for (std::size_t i = 0; i < current.counters.size(); ++i) {
+    if (sampled(i)) {
+      total.counters[i] = std::max(total.counters[i], current.counters[i]);
+    } else {
+      total.counters[i] += current.counters[i];
+    }
+  }
+  for (std::size_t i = 0; i < current.system_count; ++i) {
+    if (SystemCount *count = system_entry(total, current.systems[i].name)) {
+      count->entities += current.systems[i].entities;
+    }
+  }
+  last = current;
+  current = {};
+  frame_count++;
+}
+
+void reset() {
+  current = {};
+  last = {};
+  total = {};
+  frame_count = 0;
+}
+
+const Frame &last_frame() { return last; }
+const Frame &totals() { return total; }
+uint32_t frames() { return frame_count; }
+
+void print_counters() {
+  printf("Frame stats (X for more)\n\n");
+  for (std::size_t i = 0; i < last.counters.size(); ++i) {
+    printf("%-21s %6lu\n", COUNTER_NAMES[i],
+           static_cast<unsigned long>(last.counters[i]));
+  }
+}
+
+void print_systems() {
+  printf("Entities per system (X for more)\n\n");
+  for (std::size_t i = 0; i < last.system_count; ++i) {
+    printf("%-25.25s %4lu\n", last.systems[i].name,
+           static_cast<unsigned long>(last.systems[i].entities));
+  }
+}
+
+void dump(FILE *file, const char *label) {
+  const double per_frame = frame_count == 0 ? 1.0 : frame_count;
+  for (std::size_t i = 0; i < total.counters.size(); ++i) {
+    fprintf(file, "%s,%s,%lu,%.1f\n", label, COUNTER_NAMES[i],
+            static_cast<unsigned long>(total.counters[i]),
+            sampled(i) ? total.counters[i] : total.counters[i] / per_frame);
+  }
+  for (std::size_t i = 0; i < total.system_count; ++i) {
+    fprintf(file, "%s,%s,%lu,%.1f\n", label, total.systems[i].name,
+            static_cast<unsigned long>(total.systems[i].entities),
+            total.systems[i].entities / per_frame);
+  }
+}
+
+} // namespace stats
+
+#endif
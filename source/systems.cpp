@@ -1,22 +1,32 @@
 #include "systems.hpp"
 #include "components.hpp"
 #include "ndspp.hpp"
+#include "sprite_sort.hpp"
+#include "stats.hpp"
+#include "tcm.hpp"
 #include "tecs.hpp"
 #include "util.hpp"
+#include "world.hpp"
+#include <algorithm>
+#include <array>
+#include <cinttypes>
 #include <nds.h>
 #include <nds/arm9/exceptions.h>
 #include <nds/arm9/sprite.h>
+#include <nds/timers.h>
+#include <vector>
 
-extern unusual::id_manager<int, SPRITE_COUNT> sprite_id_manager;
-extern unusual::id_manager<int, MATRIX_COUNT> affine_index_manager;
-extern unusual::id_manager<int, 16> palette_index_manager;
+extern SpriteIdManager sprite_id_manager;
+extern AffineIdManager affine_index_manager;
+extern PaletteIdManager palette_index_manager;
+extern Camera camera;
+extern SpriteSorter sprite_sorter;
 
 using namespace Tecs;
-void apply_velocity(Tecs::Coordinator &ecs,
-                    const std::unordered_set<Tecs::Entity> &entities) {
+HOT_CODE void apply_velocity(Tecs::Coordinator &ecs, EntityRange entities) {
   for (const Entity entity : entities) {
-    auto &position = ecs.getComponent<Position>(entity).pos;
-    const Vec3 &velocity = ecs.getComponent<Velocity>(entity).v;
+    auto &position = lookup<Position>(ecs, entity).pos;
+    const Vec3 &velocity = lookup<Velocity>(ecs, entity).v;
     position.x = position.x + velocity.x;
     position.y = position.y + velocity.y;
   }
@@ -25,31 +35,35 @@ void apply_velocity(Tecs::Coordinator &ecs,
 void draw_sprites(Coordinator &ecs,
                   const std::unordered_set<Entity> &entities) {
   for (const Entity entity : entities) {
-    const auto info = ecs.getComponent<SpriteInfo>(entity);
-    const auto position = ecs.getComponent<Position>(entity).pos;
+    const auto info = lookup<SpriteInfo>(ecs, entity);
+    if (info.id == NO_SPRITE)
+      continue;
+    // Sprites are placed relative to the camera.
+    const Vec3 world_position = lookup<Position>(ecs, entity).pos;
+    const Vec3 position = {world_position.x - camera.x,
+                           world_position.y - camera.y, world_position.z};
     if (nds::fix::from_int(0) <= position.x and
         position.x <= nds::fix::from_int(SCREEN_WIDTH) and
         nds::fix::from_int(0) <= position.y and
         position.y <= nds::fix::from_int(SCREEN_HEIGHT)) {
-      oamSetHidden(&oamMain, info.id, false);
-      oamSetXY(&oamMain, info.id,
-               static_cast<int32_t>(position.x - info.width2),
-               static_cast<int32_t>(position.y - info.height2));
-    } else {
-      oamSetHidden(&oamMain, info.id, true);
+      const int32_t row = static_cast<int32_t>(position.y);
+      sprite_sorter.add(*info.sprite,
+                        static_cast<int32_t>(position.x - info.width2),
+                        static_cast<int32_t>(position.y - info.height2),
+                        std::min(row, int32_t{SCREEN_HEIGHT - 1}));
     }
   }
+  sprite_sorter.commit(&oamMain);
 }
 
 constexpr nds::fix FOLLOW_CUTOFF = nds::fix::from_float(3.0f);
 
-void following_ai(Coordinator &ecs,
-                  const std::unordered_set<Entity> &entities) {
+HOT_CODE void following_ai(Coordinator &ecs, EntityRange entities) {
   for (const auto entity : entities) {
-    Vec3 *velocity = &ecs.getComponent<Velocity>(entity).v;
-    const Following &follow = ecs.getComponent<Following>(entity);
-    const Vec3 &position = ecs.getComponent<Position>(entity).pos;
-    const Vec3 &target_position = ecs.getComponent<Position>(follow.target).pos;
+    Vec3 *velocity = &lookup<Velocity>(ecs, entity).v;
+    const Following &follow = lookup<Following>(ecs, entity);
+    const Vec3 &position = lookup<Position>(ecs, entity).pos;
+    const Vec3 &target_position = lookup<Position>(ecs, follow.target).pos;
 
     velocity->x = target_position.x - position.x;
     // Don't move if the target is too close.
@@ -67,42 +81,151 @@ void following_ai(Coordinator &ecs,
   }
 }
 
-void circular_collision_detection(Coordinator &ecs,
-                                  const std::unordered_set<Entity> &entities) {
-  for (const auto a : entities) {
-    const Collision &a_collision = ecs.getComponent<Collision>(a);
-    const Vec3 &a_position = ecs.getComponent<Position>(a).pos;
-    for (const auto b : entities) {
-      if (b == a)
+// What circular_collision_detection reads about an entity, gathered so its
+// loops touch nothing else.
+struct Collider {
+  nds::fix x;
+  nds::fix y;
+  nds::fix radius_squared;
+  Entity entity;
+  uint8_t mask;
+  uint8_t layer;
+};
+
+// An array in DTCM if it fits, or in fallback in main RAM if it doesn't.
+template <typename T>
+static T *collision_scratch(std::vector<T> &fallback, std::size_t n) {
+  T *scratch = hot_arena.allocate<T>(n);
+  if (scratch == nullptr) {
+    fallback.resize(n);
+    scratch = fallback.data();
+  }
+  return scratch;
+}
+
+HOT_CODE void
+circular_collision_detection(Coordinator &ecs,
+                             const std::unordered_set<Entity> &entities) {
+  const HotArena::Scope scope{hot_arena};
+  static std::vector<Collider> gathered_fallback;
+  static std::vector<Collider> colliders_fallback;
+  static std::vector<nds::fix> x_fallback;
+  static std::vector<nds::fix> y_fallback;
+  static std::vector<nds::fix> distance_fallback;
+  const std::size_t count = entities.size();
+  Collider *gathered = collision_scratch(gathered_fallback, count);
+
+  // Layers are bytes: count the colliders on each.
+  std::array<uint16_t, 256 + 1> layer_starts{};
+  std::size_t n = 0;
+  for (const auto entity : entities) {
+    const Collision &collision = lookup<Collision>(ecs, entity);
+    const Vec3 &position = lookup<Position>(ecs, entity).pos;
+    const auto layer = static_cast<uint8_t>(collision.layer.to_ulong());
+    gathered[n++] = {position.x,
+                     position.y,
+                     collision.radius_squared,
+                     entity,
+                     static_cast<uint8_t>(collision.mask.to_ulong()),
+                     layer};
+    layer_starts[layer + 1]++;
+  }
+
+  // Sort by layer, so each layer's positions are contiguous for the distance
+  // kernel.
+  std::array<uint8_t, 256> layers;
+  std::size_t layer_count = 0;
+  for (int layer = 0; layer < 256; ++layer) {
+    if (layer_starts[layer + 1] != 0) {
+      layers[layer_count++] = static_cast<uint8_t>(layer);
+    }
+    layer_starts[layer + 1] += layer_starts[layer];
+  }
+  Collider *colliders = collision_scratch(colliders_fallback, count);
+  nds::fix *x = collision_scratch(x_fallback, count);
+  nds::fix *y = collision_scratch(y_fallback, count);
+  nds::fix *distance = collision_scratch(distance_fallback, count);
+  std::array<uint16_t, 256> next;
+  std::copy_n(layer_starts.begin(), next.size(), next.begin());
+  for (std::size_t i = 0; i < count; ++i) {
+    const std::size_t j = next[gathered[i].layer]++;
+    colliders[j] = gathered[i];
+    x[j] = gathered[i].x;
+    y[j] = gathered[i].y;
+  }
+
+  for (std::size_t i = 0; i < count; ++i) {
+    const Collider &a = colliders[i];
+    for (std::size_t l = 0; l < layer_count; ++l) {
+      const uint8_t layer = layers[l];
+      if ((a.mask & layer) == 0)
         continue;
 
-      const Collision &b_collision = ecs.getComponent<Collision>(b);
-      if ((a_collision.mask & b_collision.layer) != 0) {
-        const Vec3 &b_position = ecs.getComponent<Position>(b).pos;
-        if (circle_circle(a_position, a_collision.radius_squared, b_position,
-                          b_collision.radius_squared)) {
-          a_collision.callback(ecs, a, b);
+      const std::size_t begin = layer_starts[layer];
+      const std::size_t end = layer_starts[layer + 1];
+      nds::kernels::distance_squared(distance + begin, x + begin, y + begin,
+                                     a.x, a.y, end - begin);
+      for (std::size_t j = begin; j < end; ++j) {
+        if (j == i)
+          continue;
+
+        const Collider &b = colliders[j];
+        STAT_INC(CollisionPairTests);
+        if (distance[j] < a.radius_squared + b.radius_squared) {
+          STAT_INC(CollisionHits);
+          lookup<Collision>(ecs, a.entity).callback(ecs, a.entity, b.entity);
         }
       }
     }
   }
 }
 
+void timer_callbacks(Coordinator &ecs,
+                     const std::unordered_set<Entity> &entities) {
+  const uint32_t now = cpuGetTiming();
+  for (const auto entity : entities) {
+
+    const TimerCallback &tc = lookup<TimerCallback>(ecs, entity);
+    if (tc.time <= now) {
+      STAT_INC(TimerCallbacks);
+      // Copied only when it fires: the callback may add components, which
+      // can move tc.
+      const auto callback = tc.callback;
+      callback(ecs, entity);
+    }
+  }
+}
+
+void health_check(Coordinator &ecs,
+                  const std::unordered_set<Entity> &entities) {
+  for (const auto entity : entities) {
+
+    const auto health = lookup<Health>(ecs, entity);
+    if (health.value <= 0) {
+      // TODO: Resolve this in 1 frame
+      add_components(ecs, entity, DeathMark{});
+      // ecs.queueDestroyEntity(entity);
+    }
+  }
+}
+
 void sprite_id_reclamation(Coordinator &ecs, const Entity entity) {
-  const auto id = ecs.getComponent<SpriteInfo>(entity).id;
-  // Hide the sprite
-  oamClearSprite(&oamMain, id);
-  sprite_id_manager.release(id);
+  release_sprite_id(ecs, entity, sprite_id_manager);
+}
+void destroy_marked(Coordinator &ecs, const Entity entity) {
+  STAT_INC(EntitiesDestroyed);
+  ecs.queueDestroyEntity(entity);
 }
+
 void affine_index_reclamation(Coordinator &ecs, const Entity entity) {
-  const auto index = ecs.getComponent<Affine>(entity).affine_index;
+  const auto index = lookup<Affine>(ecs, entity).affine_index;
   affine_index_manager.release(index);
 }
 
 void affine_rendering(Coordinator &ecs, const Entity entity) {
-  const auto affine = ecs.getComponent<Affine>(entity);
-  printf("entity: %d scale: %ld index: %ld\n", entity, affine.scale,
-         affine.affine_index);
+  const auto affine = lookup<Affine>(ecs, entity);
+  printf("entity: %d scale: %" PRId32 " index: %" PRId32 "\n", entity,
+         affine.scale, affine.affine_index);
   oamRotateScale(&oamMain, affine.affine_index, affine.rotation, affine.scale,
                  affine.scale);
 }
@@ -0,0 +1,5 @@
+#include "tcm.hpp"
+
+alignas(8) HOT_DATA static uint8_t hot_arena_buffer[HOT_ARENA_SIZE];
+
+HotArena hot_arena{hot_arena_buffer, sizeof(hot_arena_buffer)};
@@ -1,8 +1,12 @@
 #include "util.hpp"
 #include "components.hpp"
+#include "frame_pipeline.hpp"
 #include "ndspp.hpp"
+#include "particles.hpp"
+#include "stats.hpp"
+#include "tcm.hpp"
 #include "tecs.hpp"
-#include "unusual_id_manager.hpp"
+#include <algorithm>
 #include <maxmod9.h>
 #include <nds.h>
 #include <nds/arm9/math.h>
@@ -10,20 +14,137 @@
 #include <nds/timers.h>
 #include <soundbank.h>
 
+extern ParticlePool particle_pool;
+
 using namespace Tecs;
+
+static void claim_sprite_id(SpriteIdManager &sprite_id_manager, int id,
+                            Entity entity, const SpriteData &sprite_data) {
+  sprite_id_manager.owners[id] = entity;
+  sprite_id_manager.priorities[id] = sprite_data.priority;
+}
+
+static int lowest_priority_sprite_id(const SpriteIdManager &sprite_id_manager,
+                                     int8_t priority) {
+  int victim = NO_SPRITE;
+  for (int id = 0; id < SPRITE_COUNT; ++id) {
+    if (sprite_id_manager.ids.allocated(id) and
+        sprite_id_manager.priorities[id] < priority and
+        (victim == NO_SPRITE or sprite_id_manager.priorities[id] <
+                                    sprite_id_manager.priorities[victim])) {
+      victim = id;
+    }
+  }
+  return victim;
+}
+
+static int farthest_sprite_id(Coordinator &ecs,
+                              const SpriteIdManager &sprite_id_manager,
+                              int8_t priority) {
+  int victim = NO_SPRITE;
+  int32_t victim_distance = -1;
+  const Vec3 &focus = sprite_id_manager.focus;
+  for (int id = 0; id < SPRITE_COUNT; ++id) {
+    if (not sprite_id_manager.ids.allocated(id) or
+        sprite_id_manager.priorities[id] > priority) {
+      continue;
+    }
+    const Vec3 &position =
+        lookup<Position>(ecs, sprite_id_manager.owners[id]).pos;
+    // Manhattan distance in whole pixels can't overflow, unlike squaring.
+    const int32_t distance =
+        static_cast<int32_t>(nds::fix::abs(position.x - focus.x)) +
+        static_cast<int32_t>(nds::fix::abs(position.y - focus.y));
+    if (distance > victim_distance) {
+      victim = id;
+      victim_distance = distance;
+    }
+  }
+  return victim;
+}
+
+// Put entity at the back of the wait list, or count it dropped if it's full.
+static void wait_for_sprite_id(SpriteIdManager &sprite_id_manager,
+                               Entity entity) {
+  if (sprite_id_manager.waiting_count == SpriteIdManager::WAIT_LIST_LENGTH) {
+    STAT_INC(SpriteWaitsDropped);
+    return;
+  }
+  sprite_id_manager.waiting[sprite_id_manager.waiting_count++] = entity;
+}
+
+// Find a slot for entity, applying the sprite's exhaustion policy if OAM is
+// full. Returns NO_SPRITE if it didn't get one.
+static int acquire_sprite_id(Coordinator &ecs, Entity entity,
+                             SpriteIdManager &sprite_id_manager,
+                             const SpriteData &sprite_data) {
+  if (const auto id = sprite_id_manager.ids.allocate()) {
+    claim_sprite_id(sprite_id_manager, *id, entity, sprite_data);
+    return *id;
+  }
+
+  int victim = NO_SPRITE;
+  switch (sprite_data.exhaustion) {
+  case SpriteExhaustion::Fail:
+    break;
+  case SpriteExhaustion::EvictLowestPriority:
+    victim = lowest_priority_sprite_id(sprite_id_manager, sprite_data.priority);
+    break;
+  case SpriteExhaustion::EvictFarthest:
+    victim = farthest_sprite_id(ecs, sprite_id_manager, sprite_data.priority);
+    break;
+  case SpriteExhaustion::Deferred:
+    wait_for_sprite_id(sprite_id_manager, entity);
+    break;
+  }
+
+  if (victim != NO_SPRITE) {
+    // The victim keeps running, just without a sprite until it gets another.
+    const Entity evicted = sprite_id_manager.owners[victim];
+    lookup<SpriteInfo>(ecs, evicted).id = NO_SPRITE;
+    wait_for_sprite_id(sprite_id_manager, evicted);
+    STAT_INC(SpriteEvictions);
+    claim_sprite_id(sprite_id_manager, victim, entity, sprite_data);
+  }
+  return victim;
+}
+
 void make_sprite(Coordinator &ecs, Entity entity,
-                 unusual::id_manager<int, SPRITE_COUNT> &sprite_id_manager,
-                 SpriteData &sprite_data) {
-  ecs.addComponent<SpriteInfo>(entity);
-  const auto &[sprite_info] = ecs.addComponents(
-      entity,
-      SpriteInfo{sprite_id_manager.allocate(),
+                 SpriteIdManager &sprite_id_manager, SpriteData &sprite_data) {
+  add_components(ecs, entity, SpriteInfo{});
+  add_components(
+      ecs, entity,
+      SpriteInfo{acquire_sprite_id(ecs, entity, sprite_id_manager, sprite_data),
                  // Width and height are doubled to allow room for rotation
                  nds::fix::from_int(sprite_data.width) / 2,
-                 nds::fix::from_int(sprite_data.height) / 2});
-  oamSet(&oamMain, sprite_info.id, 5, 5, 0, sprite_data.palette_index,
-         sprite_data.size, sprite_data.color_format, sprite_data.vram_memory,
-         -1, false, false, false, false, false);
+                 nds::fix::from_int(sprite_data.height) / 2, &sprite_data});
+}
+
+void release_sprite_id(Coordinator &ecs, Entity entity,
+                       SpriteIdManager &sprite_id_manager) {
+  const int id = lookup<SpriteInfo>(ecs, entity).id;
+  auto &waiting = sprite_id_manager.waiting;
+  if (id == NO_SPRITE) {
+    // Drop it from the wait list, if it's on there.
+    const auto end = waiting.begin() + sprite_id_manager.waiting_count;
+    if (std::remove(waiting.begin(), end, entity) != end) {
+      sprite_id_manager.waiting_count--;
+    }
+    return;
+  }
+
+  if (sprite_id_manager.waiting_count == 0) {
+    sprite_id_manager.ids.release(id);
+    return;
+  }
+
+  const Entity heir = waiting[0];
+  std::copy(waiting.begin() + 1,
+            waiting.begin() + sprite_id_manager.waiting_count, waiting.begin());
+  sprite_id_manager.waiting_count--;
+  SpriteInfo &heir_info = lookup<SpriteInfo>(ecs, heir);
+  heir_info.id = id;
+  claim_sprite_id(sprite_id_manager, id, heir, *heir_info.sprite);
 }
 
 nds::fix radius_squared_from_diameter(nds::fix diameter) {
@@ -32,9 +153,9 @@ nds::fix radius_squared_from_diameter(nds::fix diameter) {
 }
 
 Entity make_fireball(Coordinator &ecs, Vec3 position, Vec3 target,
-                     unusual::id_manager<int, SPRITE_COUNT> &sprite_id_manager,
-                     SpriteData &sprite) {
+                     SpriteIdManager &sprite_id_manager, SpriteData &sprite) {
   Entity fireball = ecs.newEntity();
+  STAT_INC(EntitiesCreated);
 
   // constexpr nds::fix FIREBALL_SPEED = nds::fix::from_float(2.0f);
 
@@ -45,74 +166,70 @@ Entity make_fireball(Coordinator &ecs, Vec3 position, Vec3 target,
   // velocity.x = velocity.x * FIREBALL_SPEED;
   // velocity.y = velocity.y * FIREBALL_SPEED;
 
-  ecs.addComponents(
-      fireball, Position{position}, Velocity{velocity},
+  add_components(
+      ecs, fireball, Position{position}, Velocity{velocity},
       Collision{ZOMBIE_LAYER, PLAYER_ATTACK_LAYER,
                 radius_squared_from_diameter(nds::fix::from_int(sprite.width)),
                 take_damage},
-      TimerCallback{cpuGetTiming() + BUS_CLOCK * 4,
-                    [](Tecs::Coordinator &ecs, const Tecs::Entity entity) {
-                      ecs.addComponent<DeathMark>(entity);
-                    }},
-      Health{2});
+      TimerCallback{cpuGetTiming() + BUS_CLOCK * 4, self_destruct},
+      Health{2}, ParticleTrail{3, 0}, ChunkCell{NO_CHUNK}, Awake{});
+  emit_burst(particle_pool, position, 6, nds::fix::from_float(0.75f), 12);
   return fireball;
 }
 
 Tecs::Entity
 make_zombie(Coordinator &ecs, Vec3 position, Tecs::Entity player,
-            nds::fix speed,
-            unusual::id_manager<int, SPRITE_COUNT> &sprite_id_manager,
+            nds::fix speed, SpriteIdManager &sprite_id_manager,
             SpriteData &sprite) {
   using namespace nds;
   Tecs::Entity zombie = ecs.newEntity();
+  STAT_INC(EntitiesCreated);
   const nds::fix zombie_radius_squared =
       radius_squared_from_diameter(nds::fix::from_int(sprite.width));
   make_sprite(ecs, zombie, sprite_id_manager, sprite);
-  ecs.addComponent<Zombie>(zombie);
+  add_components(ecs, zombie, Zombie{});
 
-  ecs.addComponents(zombie, Position{position}, Velocity{},
-                    Collision{PLAYER_ATTACK_LAYER | PLAYER_LAYER, ZOMBIE_LAYER,
-                              zombie_radius_squared, take_damage},
-                    Following{player, speed}, Health{1});
+  add_components(ecs, zombie, Position{position}, Velocity{},
+                 Collision{PLAYER_ATTACK_LAYER | PLAYER_LAYER, ZOMBIE_LAYER,
+                           zombie_radius_squared, take_damage},
+                 Following{player, speed}, Health{1}, ChunkCell{NO_CHUNK},
+                 Awake{});
   return zombie;
 }
 
 Entity make_explosion(Coordinator &ecs, Vec3 position,
-                      unusual::id_manager<int, SPRITE_COUNT> &sprite_id_manager,
-                      SpriteData &sprite) {
+                      SpriteIdManager &sprite_id_manager, SpriteData &sprite) {
   Entity explosion = ecs.newEntity();
+  STAT_INC(EntitiesCreated);
 
   make_sprite(ecs, explosion, sprite_id_manager, sprite);
   // const auto affine_index = affine_index_manager.allocate();
   // oamSetAffineIndex(&oamMain, ecs.getComponent<SpriteInfo>(explosion).id,
   //                   affine_index, true);
 
-  ecs.addComponents(
-      explosion, Position{position},
+  add_components(
+      ecs, explosion, Position{position},
       Collision{ZOMBIE_LAYER, PLAYER_ATTACK_LAYER,
                 radius_squared_from_diameter(nds::fix::from_int(sprite.width)),
                 take_damage},
       // Affine{affine_index, 0, 1 << 8},
-      Health{20}, TimerCallback{cpuGetTiming() + BUS_CLOCK * 1, self_destruct});
+      Health{20}, TimerCallback{cpuGetTiming() + BUS_CLOCK * 1, self_destruct},
+      ChunkCell{NO_CHUNK}, Awake{});
+  emit_burst(particle_pool, position, 48, nds::fix::from_float(3.0f), 30);
   return explosion;
 }
 
-bool circle_circle(Vec3 a_position, nds::fix a_radius_squared, Vec3 b_position,
-                   nds::fix b_radius_squared) {
-  const nds::fix x_diff = a_position.x - b_position.x;
-  const nds::fix y_diff = a_position.y - b_position.y;
-  return (x_diff * x_diff) + (y_diff * y_diff) <
-         (a_radius_squared + b_radius_squared);
-}
-
 void self_destruct(Coordinator &ecs, Entity self) {
-  ecs.addComponent<DeathMark>(self);
+  add_components(ecs, self, DeathMark{});
 }
 
 void take_damage(Coordinator &ecs, Entity self, Entity other) {
   std::ignore = other;
   mmEffect(SFX_HIT);
-  ecs.getComponent<Health>(self).value--;
+  STAT_INC(SoundEffects);
+  lookup<Health>(ecs, self).value--;
+  emit_burst(particle_pool, lookup<Position>(ecs, self).pos, 4,
+             nds::fix::from_float(1.5f), 12);
 }
 
 void wait_for_start() {
@@ -178,14 +295,15 @@ constexpr SpriteSize sprite_size(int width, int height) {
 }
 
 SpriteData::SpriteData(OamState *oam, const uint8_t *gfx, int width, int height,
-                       int tiles,
-                       unusual::id_manager<int, 16> &palette_index_manager,
+                       int tiles, PaletteIdManager &palette_index_manager,
                        SpriteColorFormat color_format, const uint8_t *palette,
-                       int palette_length, _ext_palette palette_memory)
+                       int palette_length, _ext_palette palette_memory,
+                       int8_t priority, SpriteExhaustion exhaustion)
     : size{sprite_size(width, height)}, width{width}, height{height},
       tiles{tiles}, palette_index_manager{palette_index_manager},
-      palette_index{palette_index_manager.allocate()},
-      color_format{color_format}, gfx{gfx},
+      palette_index{palette_index_manager.allocate().value()},
+      priority{priority}, exhaustion{exhaustion}, color_format{color_format},
+      gfx{gfx},
       vram_memory{oamAllocateGfx(oam, size, color_format)}, oam{oam} {
   set_active_tile(0);
   dmaCopy(palette, &palette_memory[palette_index][0], palette_length);
@@ -197,6 +315,6 @@ SpriteData::~SpriteData() {
 
 void SpriteData::set_active_tile(int n) {
   assert(0 <= n and n < tiles);
-  dmaCopy(gfx + SPRITE_SIZE_PIXELS(size) * n, vram_memory,
-          SPRITE_SIZE_PIXELS(size));
+  frame::upload(vram_memory, gfx + SPRITE_SIZE_PIXELS(size) * n,
+                SPRITE_SIZE_PIXELS(size));
 }
@@ -0,0 +1,128 @@
+#include "world.hpp"
+#include "components.hpp"
+#include "ndspp.hpp"
+#include "stats.hpp"
+#include "tecs.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <nds.h>
+
+extern WorldChunks world_chunks;
+
+using namespace Tecs;
+
+static bool awake_around(int16_t centre, int16_t chunk) {
+  if (centre == NO_CHUNK) {
+    return true;
+  }
+  return std::abs(chunk % CHUNK_COLUMNS - centre % CHUNK_COLUMNS) <=
+             AWAKE_RADIUS and
+         std::abs(chunk / CHUNK_COLUMNS - centre / CHUNK_COLUMNS) <=
+             AWAKE_RADIUS;
+}
+
+bool WorldChunks::awake(int16_t chunk) const {
+  return awake_around(centre, chunk);
+}
+
+std::size_t WorldChunks::population() const {
+  std::size_t total = 0;
+  for (const auto &chunk : members) {
+    total += chunk.size();
+  }
+  return total;
+}
+
+void WorldChunks::reset() {
+  for (auto &chunk : members) {
+    chunk.clear();
+  }
+  centre = NO_CHUNK;
+}
+
+int16_t chunk_of(const Vec3 &position) {
+  const int column = std::clamp(static_cast<int32_t>(position.x) / CHUNK_SIZE,
+                                0, CHUNK_COLUMNS - 1);
+  const int row = std::clamp(static_cast<int32_t>(position.y) / CHUNK_SIZE, 0,
+                             CHUNK_ROWS - 1);
+  return static_cast<int16_t>(row * CHUNK_COLUMNS + column);
+}
+
+void update_camera(Camera &camera, const Vec3 &focus) {
+  camera.x = std::clamp(focus.x - nds::fix::from_int(SCREEN_WIDTH / 2),
+                        nds::fix::from_int(0),
+                        nds::fix::from_int(WORLD_WIDTH - SCREEN_WIDTH));
+  camera.y = std::clamp(focus.y - nds::fix::from_int(SCREEN_HEIGHT / 2),
+                        nds::fix::from_int(0),
+                        nds::fix::from_int(WORLD_HEIGHT - SCREEN_HEIGHT));
+}
+
+static void sleep_entity(Coordinator &ecs, Entity entity) {
+  ecs.removeComponent<Awake>(entity);
+  STAT_INC(StructuralChanges);
+}
+
+void update_awake_region(Coordinator &ecs, WorldChunks &world_chunks,
+                         const Vec3 &focus) {
+  const int16_t centre = chunk_of(focus);
+  if (centre == world_chunks.centre) {
+    return;
+  }
+  const int16_t previous = world_chunks.centre;
+  world_chunks.centre = centre;
+
+  for (int16_t chunk = 0; chunk < CHUNK_COUNT; ++chunk) {
+    const bool was_awake = awake_around(previous, chunk);
+    const bool is_awake = awake_around(centre, chunk);
+    if (was_awake == is_awake) {
+      continue;
+    }
+    for (const Entity entity : world_chunks.members[chunk]) {
+      if (is_awake) {
+        add_components(ecs, entity, Awake{});
+      } else {
+        sleep_entity(ecs, entity);
+      }
+    }
+  }
+}
+
+static void leave_chunk(Entity entity, int16_t chunk) {
+  if (chunk == NO_CHUNK) {
+    return;
+  }
+  auto &members = world_chunks.members[chunk];
+  const auto found = std::find(members.begin(), members.end(), entity);
+  if (found != members.end()) {
+    *found = members.back();
+    members.pop_back();
+  }
+}
+
+void chunk_tracking(Coordinator &ecs,
+                    const std::unordered_set<Entity> &entities) {
+  // Sleeping removes Awake, which would change the set being iterated over.
+  static std::vector<Entity> sleepers;
+  sleepers.clear();
+  for (const Entity entity : entities) {
+    ChunkCell &cell = lookup<ChunkCell>(ecs, entity);
+    const int16_t chunk = chunk_of(lookup<Position>(ecs, entity).pos);
+    if (chunk == cell.chunk) {
+      continue;
+    }
+    leave_chunk(entity, cell.chunk);
+    world_chunks.members[chunk].push_back(entity);
+    cell.chunk = chunk;
+    if (not world_chunks.awake(chunk)) {
+      sleepers.push_back(entity);
+    }
+  }
+  for (const Entity entity : sleepers) {
+    sleep_entity(ecs, entity);
+  }
+}
+
+void chunk_reclamation(Coordinator &ecs, const Entity entity) {
+  leave_chunk(entity, lookup<ChunkCell>(ecs, entity).chunk);
+}